@@ -10,11 +10,23 @@ TARGET = ewam-network-tester
 HEADERS += \
     ../AbstractNetworkInterface/pe.h \
     ../AbstractNetworkInterface/emitter.h \
-    networkedEWAM.h
+    networkedEWAM.h \
+    kinematics.h \
+    spscRing.h \
+    slotMap.h \
+    trackFile.h \
+    trackStore.h \
+    updateScheduler.h \
+    shardCoordinator.h
 
 SOURCES += \
     main.cpp \
-    networkedEWAM.cpp
+    networkedEWAM.cpp \
+    kinematics.cpp \
+    trackFile.cpp \
+    trackStore.cpp \
+    updateScheduler.cpp \
+    shardCoordinator.cpp
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
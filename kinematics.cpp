@@ -0,0 +1,234 @@
+#include "kinematics.h"
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace Kinematics {
+
+static const double DEG_TO_RAD = M_PI / 180.0;
+static const double RAD_TO_DEG = 180.0 / M_PI;
+
+void advanceGreatCircle(double& lat, double& lon, double headingDeg, double distanceKm) {
+    double lat1 = lat * DEG_TO_RAD;
+    double lon1 = lon * DEG_TO_RAD;
+    double bearing = headingDeg * DEG_TO_RAD;
+
+    double angular_distance = distanceKm / EARTH_RADIUS_KM;
+
+    double lat2 = asin(sin(lat1) * cos(angular_distance) +
+                      cos(lat1) * sin(angular_distance) * cos(bearing));
+
+    double lon2 = lon1 + atan2(sin(bearing) * sin(angular_distance) * cos(lat1),
+                              cos(angular_distance) - sin(lat1) * sin(lat2));
+
+    lat = lat2 * RAD_TO_DEG;
+    lon = lon2 * RAD_TO_DEG;
+}
+
+void anchorFrame(LocalTangentFrame& frame, double lat, double lon) {
+    frame.originLat = lat;
+    frame.originLon = lon;
+    frame.cosOriginLat = cos(lat * DEG_TO_RAD);
+    frame.sinOriginLat = sin(lat * DEG_TO_RAD);
+    frame.east = 0.0;
+    frame.north = 0.0;
+}
+
+void advanceLocalTangent(LocalTangentFrame& frame, double headingDeg, double distanceKm) {
+    // Straight-and-level flight keeps its heading, so trig is only redone in turns
+    if (headingDeg != frame.cachedHeading) {
+        frame.cachedHeading = headingDeg;
+        frame.sinHeading = sin(headingDeg * DEG_TO_RAD);
+        frame.cosHeading = cos(headingDeg * DEG_TO_RAD);
+    }
+
+    frame.east += distanceKm * frame.sinHeading;
+    frame.north += distanceKm * frame.cosHeading;
+}
+
+void projectFrame(const LocalTangentFrame& frame, double& lat, double& lon) {
+    double dLat = frame.north / EARTH_RADIUS_KM;
+
+    // Scale east by the mid-latitude circle, expanded to first order to stay trig-free
+    double cosMidLat = frame.cosOriginLat - frame.sinOriginLat * dLat * 0.5;
+
+    lat = frame.originLat + dLat * RAD_TO_DEG;
+    lon = frame.originLon + (frame.east / (EARTH_RADIUS_KM * cosMidLat)) * RAD_TO_DEG;
+}
+
+bool frameDrifted(const LocalTangentFrame& frame, double toleranceKm) {
+    return fabs(frame.east) > toleranceKm || fabs(frame.north) > toleranceKm;
+}
+
+double distanceKm(double lat1, double lon1, double lat2, double lon2) {
+    double dLat = (lat2 - lat1) * DEG_TO_RAD;
+    double dLon = (lon2 - lon1) * DEG_TO_RAD;
+    double a = sin(dLat / 2) * sin(dLat / 2) +
+               cos(lat1 * DEG_TO_RAD) * cos(lat2 * DEG_TO_RAD) * sin(dLon / 2) * sin(dLon / 2);
+    return 2 * EARTH_RADIUS_KM * atan2(sqrt(a), sqrt(1 - a));
+}
+
+// Benchmark entity: starting state plus a repeating turn/straight profile
+struct BenchEntity {
+    double lat;
+    double lon;
+    double heading;
+    double speed;       // knots
+    double turnRate;    // degrees per second while turning
+    int phase;          // offsets the profile so entities don't all turn together
+};
+
+static const int PROFILE_PERIOD_S = 120;
+static const int PROFILE_TURN_S = 20;
+
+static std::vector<BenchEntity> makeBenchEntities(int entityCount) {
+    std::vector<BenchEntity> population;
+    population.reserve(entityCount);
+
+    // Fixed LCG so every run flies the same population
+    unsigned int seed = 12345;
+    auto next = [&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 16) & 0x7fff;
+    };
+
+    for (int i = 0; i < entityCount; ++i) {
+        BenchEntity entity;
+        entity.lat = -37.814 + (static_cast<int>(next() % 1000) - 500) * 0.0005;
+        entity.lon = 144.963 + (static_cast<int>(next() % 1000) - 500) * 0.0005;
+        entity.heading = next() % 360;
+        entity.speed = 300 + next() % 300;
+        entity.turnRate = (next() % 2) ? 3.0 : -3.0;
+        entity.phase = next() % PROFILE_PERIOD_S;
+        population.push_back(entity);
+    }
+    return population;
+}
+
+static inline void advanceHeading(double& heading, const BenchEntity& entity, double elapsedS, double stepS) {
+    int profileS = (static_cast<int>(elapsedS) + entity.phase) % PROFILE_PERIOD_S;
+    if (profileS < PROFILE_TURN_S) {
+        heading += entity.turnRate * stepS;
+        if (heading >= 360) heading -= 360;
+        if (heading < 0) heading += 360;
+    }
+}
+
+// Times the local-tangent integrator over the population. The live sender
+// projects every emitted tick, so that is timed as well as the lower bound
+// of projecting only when re-anchoring.
+static double timeLocalTangent(const std::vector<BenchEntity>& population, long steps, double stepS,
+                               double toleranceKm, bool projectEveryStep, long& reanchors, double& sink) {
+    typedef std::chrono::steady_clock Clock;
+    const double stepHours = stepS / 3600.0;
+
+    reanchors = 0;
+    Clock::time_point start = Clock::now();
+    for (const BenchEntity& initial : population) {
+        LocalTangentFrame frame;
+        anchorFrame(frame, initial.lat, initial.lon);
+        double heading = initial.heading;
+        double lat = initial.lat;
+        double lon = initial.lon;
+        for (long step = 0; step < steps; ++step) {
+            advanceLocalTangent(frame, heading, initial.speed * stepHours * 1.852);
+            if (projectEveryStep) {
+                projectFrame(frame, lat, lon);
+                sink += lat;
+            }
+            if (frameDrifted(frame, toleranceKm)) {
+                projectFrame(frame, lat, lon);
+                anchorFrame(frame, lat, lon);
+                ++reanchors;
+            }
+            advanceHeading(heading, initial, step * stepS, stepS);
+        }
+        projectFrame(frame, lat, lon);
+        sink += lat + lon;
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void runValidationBenchmark(int entityCount, double durationS, int stepMs, double toleranceKm) {
+    typedef std::chrono::steady_clock Clock;
+
+    const std::vector<BenchEntity> population = makeBenchEntities(entityCount);
+    const double stepS = stepMs / 1000.0;
+    const long steps = static_cast<long>(durationS / stepS);
+    const double stepHours = stepS / 3600.0;
+
+    std::cout << "Validating local-tangent kinematics: " << entityCount << " entities, "
+              << steps << " steps of " << stepMs << "ms, re-anchor at "
+              << toleranceKm << " km" << std::endl;
+
+    // Pass 1: great-circle timing
+    double sink = 0.0;
+    Clock::time_point start = Clock::now();
+    for (const BenchEntity& initial : population) {
+        double lat = initial.lat;
+        double lon = initial.lon;
+        double heading = initial.heading;
+        for (long step = 0; step < steps; ++step) {
+            advanceGreatCircle(lat, lon, heading, initial.speed * stepHours * 1.852);
+            advanceHeading(heading, initial, step * stepS, stepS);
+        }
+        sink += lat + lon;
+    }
+    double greatCircleS = std::chrono::duration<double>(Clock::now() - start).count();
+
+    // Pass 2: local-tangent timing, as emitted every tick and as a lower bound
+    long reanchors = 0;
+    double projectedS = timeLocalTangent(population, steps, stepS, toleranceKm, true, reanchors, sink);
+    double anchoredS = timeLocalTangent(population, steps, stepS, toleranceKm, false, reanchors, sink);
+
+    // Pass 3: both integrators in lockstep, comparing every emitted position
+    double maxErrorKm = 0.0;
+    double finalErrorSumKm = 0.0;
+    for (const BenchEntity& initial : population) {
+        double gcLat = initial.lat;
+        double gcLon = initial.lon;
+        LocalTangentFrame frame;
+        anchorFrame(frame, initial.lat, initial.lon);
+        double heading = initial.heading;
+        double lat = initial.lat;
+        double lon = initial.lon;
+        for (long step = 0; step < steps; ++step) {
+            double distance = initial.speed * stepHours * 1.852;
+            advanceGreatCircle(gcLat, gcLon, heading, distance);
+            advanceLocalTangent(frame, heading, distance);
+            projectFrame(frame, lat, lon);
+            if (frameDrifted(frame, toleranceKm)) {
+                anchorFrame(frame, lat, lon);
+            }
+            advanceHeading(heading, initial, step * stepS, stepS);
+
+            double error = distanceKm(gcLat, gcLon, lat, lon);
+            if (error > maxErrorKm) maxErrorKm = error;
+        }
+        finalErrorSumKm += distanceKm(gcLat, gcLon, lat, lon);
+    }
+
+    long updates = static_cast<long>(entityCount) * steps;
+    std::cout << std::fixed << std::setprecision(3)
+              << "  great-circle:   " << greatCircleS << " s ("
+              << updates / greatCircleS / 1e6 << " M steps/s)" << std::endl
+              << "  local-tangent:  " << projectedS << " s ("
+              << updates / projectedS / 1e6 << " M steps/s) projecting every step" << std::endl
+              << "                  " << anchoredS << " s ("
+              << updates / anchoredS / 1e6 << " M steps/s) projecting on re-anchor only, "
+              << reanchors << " re-anchors" << std::endl
+              << std::setprecision(2)
+              << "  speed-up:       " << greatCircleS / projectedS << "x every step, "
+              << greatCircleS / anchoredS << "x on re-anchor only" << std::endl
+              << std::setprecision(1)
+              << "  max error:      " << maxErrorKm * 1000.0 << " m" << std::endl
+              << "  mean end error: " << (entityCount > 0 ? finalErrorSumKm / entityCount * 1000.0 : 0.0)
+              << " m after " << durationS << " s" << std::endl
+              << std::setprecision(3)
+              << "  (checksum " << sink << ")" << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+}
+
+}
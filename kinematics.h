@@ -0,0 +1,45 @@
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+// Position integrators shared by the live simulation and the validation benchmark
+
+enum class Integrator {
+    GreatCircle,    // Exact spherical step every tick
+    LocalTangent    // Flat east/north frame, re-anchored when drift exceeds a tolerance
+};
+
+// Local east/north frame anchored at a geodetic origin. Trig of the origin
+// latitude and of the current heading is cached so a step is a few multiply-adds.
+struct LocalTangentFrame {
+    double originLat = 0.0;     // degrees
+    double originLon = 0.0;     // degrees
+    double cosOriginLat = 1.0;
+    double sinOriginLat = 0.0;
+    double east = 0.0;          // km from origin
+    double north = 0.0;         // km from origin
+    double cachedHeading = -1.0;
+    double sinHeading = 0.0;
+    double cosHeading = 1.0;
+};
+
+namespace Kinematics {
+
+const double EARTH_RADIUS_KM = 6371.0;
+
+void advanceGreatCircle(double& lat, double& lon, double headingDeg, double distanceKm);
+
+void anchorFrame(LocalTangentFrame& frame, double lat, double lon);
+void advanceLocalTangent(LocalTangentFrame& frame, double headingDeg, double distanceKm);
+void projectFrame(const LocalTangentFrame& frame, double& lat, double& lon);
+bool frameDrifted(const LocalTangentFrame& frame, double toleranceKm);
+
+// Great-circle distance between two points in degrees
+double distanceKm(double lat1, double lon1, double lat2, double lon2);
+
+// Flies the same manoeuvre profile through both integrators and reports the
+// speed-up and position error of the local-tangent path
+void runValidationBenchmark(int entityCount, double durationS, int stepMs, double toleranceKm);
+
+}
+
+#endif // KINEMATICS_H
@@ -2,9 +2,11 @@
 #include <QCommandLineParser>
 #include <QCommandLineOption>
 #include <QTimer>
+#include <QDateTime>
 #include <csignal>
 #include <iostream>
 #include "networkedEWAM.h"
+#include "shardCoordinator.h"
 
 // Signal handler function prototype
 void signalHandler(int signal);
@@ -30,11 +32,47 @@ int main(int argc, char *argv[]) {
 
     // Simulation options (using 'V' instead of 'v' for verbose)
     QCommandLineOption scenarioOption(QStringList() << "s" << "scenario",
-                                      "Simulation scenario (melbourne, convoy, combat, custom)", "scenario", "melbourne");
+                                      "Simulation scenario (melbourne, convoy, combat, custom, theatre)", "scenario", "melbourne");
     QCommandLineOption intervalOption(QStringList() << "i" << "interval",
                                       "Update interval in milliseconds", "interval", "1000");
     QCommandLineOption verboseOption(QStringList() << "V" << "verbose",
                                      "Enable verbose output");
+    QCommandLineOption entitiesOption(QStringList() << "n" << "entities",
+                                      "Number of entities in the theatre scenario", "count", "1000");
+    QCommandLineOption seedOption("seed",
+                                  "Random seed for scenario generation", "seed");
+
+    QCommandLineOption kinematicsOption("kinematics",
+                                        "Position integrator (great-circle, local-tangent)", "mode", "great-circle");
+    QCommandLineOption reanchorOption("reanchor-km",
+                                      "Local-tangent drift in km before re-anchoring", "km", "5");
+    QCommandLineOption validateKinematicsOption("validate-kinematics",
+                                                "Benchmark local-tangent against great-circle kinematics and exit");
+    QCommandLineOption durationOption("duration",
+                                      "Simulated duration in seconds for benchmark and offline runs", "seconds", "3600");
+    QCommandLineOption offlineOption("offline",
+                                     "Generate the scenario into a columnar track file instead of sending it", "file");
+    QCommandLineOption epochOption("epoch",
+                                   "Offline runs: simulation start time in ms since the Unix epoch", "ms", "1704067200000");
+
+    QCommandLineOption adaptiveRatesOption("adaptive-rates",
+                                           "Send each entity at a rate set by its platform type and manoeuvring");
+    QCommandLineOption budgetOption("budget",
+                                    "Adaptive rates: cap on entity messages per second (0 for none)", "msgs", "0");
+    QCommandLineOption churnOption("churn",
+                                   "Despawn and spawn this many entities per second, for soak runs", "rate", "0");
+    QCommandLineOption pipelineOption("pipeline",
+                                      "Simulate, serialize and transmit on separate threads");
+    QCommandLineOption queueDepthOption("queue-depth",
+                                        "Messages buffered between pipeline stages", "count", "4096");
+
+    // Sharding options
+    QCommandLineOption shardsOption("shards",
+                                    "Split the simulation across this many local worker processes", "count", "1");
+    QCommandLineOption shardModeOption("shard-mode",
+                                       "How entities are split between shards (region, id)", "mode", "region");
+    QCommandLineOption shardIndexOption("shard-index",
+                                        "Run as the given shard worker (used by the coordinator)", "index");
 
     // Mode options
     QCommandLineOption serverOption(QStringList() << "server",
@@ -44,6 +82,11 @@ int main(int argc, char *argv[]) {
     QCommandLineOption messageOption(QStringList() << "m" << "message",
                                      "Test message to send in test mode", "message", "Hello World");
 
+    QCommandLineOption trackCapacityOption("track-capacity",
+                                           "Server mode: number of ids the track store can hold", "count", "16384");
+    QCommandLineOption trackHistoryOption("track-history",
+                                          "Server mode: samples of history kept per id", "count", "16");
+
     QCommandLineOption noReconnectOption("no-reconnect",
                                          "Disable automatic reconnection attempts");
     QCommandLineOption reconnectIntervalOption(QStringList() << "r" << "reconnect-interval", "Reconnection attempt interval in seconds", "seconds", "5");
@@ -58,6 +101,24 @@ int main(int argc, char *argv[]) {
     parser.addOption(serverOption);
     parser.addOption(testOption);
     parser.addOption(messageOption);
+    parser.addOption(trackCapacityOption);
+    parser.addOption(trackHistoryOption);
+    parser.addOption(entitiesOption);
+    parser.addOption(seedOption);
+    parser.addOption(kinematicsOption);
+    parser.addOption(reanchorOption);
+    parser.addOption(validateKinematicsOption);
+    parser.addOption(durationOption);
+    parser.addOption(offlineOption);
+    parser.addOption(epochOption);
+    parser.addOption(adaptiveRatesOption);
+    parser.addOption(budgetOption);
+    parser.addOption(churnOption);
+    parser.addOption(pipelineOption);
+    parser.addOption(queueDepthOption);
+    parser.addOption(shardsOption);
+    parser.addOption(shardModeOption);
+    parser.addOption(shardIndexOption);
 
     parser.process(app);
 
@@ -72,10 +133,31 @@ int main(int argc, char *argv[]) {
     QString testMessage = parser.value(messageOption);
     bool autoReconnect = !parser.isSet(noReconnectOption);
     int reconnectInterval = parser.value(reconnectIntervalOption).toInt() * 1000; // Convert to ms
+    int entityCount = parser.value(entitiesOption).toInt();
+    uint seed = parser.isSet(seedOption) ? parser.value(seedOption).toUInt()
+                                         : static_cast<uint>(QDateTime::currentMSecsSinceEpoch());
+    QString kinematics = parser.value(kinematicsOption);
+    double reanchorKm = parser.value(reanchorOption).toDouble();
+    double duration = parser.value(durationOption).toDouble();
+    int trackCapacity = parser.value(trackCapacityOption).toInt();
+    int trackHistory = parser.value(trackHistoryOption).toInt();
+    bool offlineMode = parser.isSet(offlineOption);
+    QString offlinePath = parser.value(offlineOption);
+    qint64 epochMs = parser.value(epochOption).toLongLong();
+    bool adaptiveRates = parser.isSet(adaptiveRatesOption);
+    double budget = parser.value(budgetOption).toDouble();
+    double churn = parser.value(churnOption).toDouble();
+    bool pipeline = parser.isSet(pipelineOption);
+    int queueDepth = parser.value(queueDepthOption).toInt();
+    int shardCount = parser.value(shardsOption).toInt();
+    QString shardMode = parser.value(shardModeOption);
+    bool shardWorker = parser.isSet(shardIndexOption);
+    int shardIndex = parser.value(shardIndexOption).toInt();
+    bool coordinatorMode = shardCount > 1 && !shardWorker && !serverMode && !testMode && !offlineMode;
 
     // Validate scenario if we're not in server or test mode
     if (!serverMode && !testMode) {
-        QStringList validScenarios = {"melbourne", "convoy", "combat", "custom"};
+        QStringList validScenarios = {"melbourne", "convoy", "combat", "custom", "theatre"};
         if (!validScenarios.contains(scenario)) {
             std::cerr << "Invalid scenario. Valid options are: "
                       << validScenarios.join(", ").toStdString() << std::endl;
@@ -83,6 +165,56 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    // Validate kinematics
+    if (kinematics != "great-circle" && kinematics != "local-tangent") {
+        std::cerr << "Invalid kinematics. Valid options are: great-circle, local-tangent" << std::endl;
+        return 1;
+    }
+    if (reanchorKm <= 0) {
+        std::cerr << "Re-anchor distance must be positive" << std::endl;
+        return 1;
+    }
+
+    if (parser.isSet(validateKinematicsOption)) {
+        if (duration <= 0 || interval <= 0) {
+            std::cerr << "Duration and interval must be positive" << std::endl;
+            return 1;
+        }
+        Kinematics::runValidationBenchmark(entityCount, duration, interval, reanchorKm);
+        return 0;
+    }
+
+    if (budget < 0) {
+        std::cerr << "Budget must not be negative" << std::endl;
+        return 1;
+    }
+    if (churn < 0) {
+        std::cerr << "Churn rate must not be negative" << std::endl;
+        return 1;
+    }
+    if (pipeline && interval <= 0) {
+        std::cerr << "Pipeline mode needs a positive interval" << std::endl;
+        return 1;
+    }
+    if (pipeline && queueDepth < 2) {
+        std::cerr << "Queue depth must be at least 2" << std::endl;
+        return 1;
+    }
+
+    // Validate sharding
+    if (shardCount < 1) {
+        std::cerr << "Shard count must be at least 1" << std::endl;
+        return 1;
+    }
+    if (shardMode != "region" && shardMode != "id") {
+        std::cerr << "Invalid shard mode. Valid options are: region, id" << std::endl;
+        return 1;
+    }
+    if (shardWorker && (shardIndex < 0 || shardIndex >= shardCount)) {
+        std::cerr << "Shard index must be between 0 and " << shardCount - 1 << std::endl;
+        return 1;
+    }
+
     // Validate interval
     if (interval < 100) {
         std::cerr << "Warning: Update interval less than 100ms may cause performance issues" << std::endl;
@@ -96,14 +228,93 @@ int main(int argc, char *argv[]) {
         std::cout << "Server: " << host.toStdString() << ":" << port << std::endl;
         std::cout << "Test message: " << testMessage.toStdString() << std::endl;
         std::cout << "Interval: " << interval << "ms" << std::endl;
+    } else if (offlineMode) {
+        std::cout << "Starting " << scenario.toStdString() << " scenario offline..." << std::endl;
+        std::cout << "Output: " << offlinePath.toStdString() << std::endl;
+        std::cout << "Step: " << interval << "ms, duration: " << duration << "s" << std::endl;
     } else {
         std::cout << "Starting " << scenario.toStdString() << " scenario..." << std::endl;
         std::cout << "Server: " << host.toStdString() << ":" << port << std::endl;
         std::cout << "Update interval: " << interval << "ms" << std::endl;
+        if (coordinatorMode) {
+            std::cout << "Shards: " << shardCount << " (" << shardMode.toStdString() << ")" << std::endl;
+        }
+    }
+
+    // Coordinator only supervises the workers and merges their streams
+    if (coordinatorMode) {
+        ShardLaunchConfig config;
+        config.shardCount = shardCount;
+        config.mode = shardMode == "id" ? ShardMode::IdRange : ShardMode::Region;
+        config.scenario = scenario;
+        config.interval = interval;
+        config.entityCount = entityCount;
+        config.seed = seed;
+        config.upstreamHost = host;
+        config.upstreamPort = port;
+        config.workerOptions << "--kinematics" << kinematics
+                             << "--reanchor-km" << QString::number(reanchorKm);
+        if (adaptiveRates) {
+            // Each shard gets an equal share of the global budget
+            config.workerOptions << "--adaptive-rates"
+                                 << "--budget" << QString::number(budget / shardCount);
+        }
+        if (churn > 0) {
+            config.workerOptions << "--churn" << QString::number(churn / shardCount);
+        }
+        if (pipeline) {
+            config.workerOptions << "--pipeline" << "--queue-depth" << QString::number(queueDepth);
+        }
+
+        ShardCoordinator coordinator;
+        if (!coordinator.start(config)) {
+            return 1;
+        }
+
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [&coordinator]() {
+            std::cout << "\nStopping shards..." << std::endl;
+            coordinator.stop();
+        });
+
+        signal(SIGINT, signalHandler);
+        signal(SIGTERM, signalHandler);
+
+        int result = app.exec();
+        std::cout << "Application ended." << std::endl;
+        return result;
     }
 
     // Create sender instance
     NetworkedEWAM sender;
+    sender.setRandomSeed(seed);
+    sender.setEntityCount(entityCount);
+    sender.setIntegrator(kinematics == "local-tangent" ? Integrator::LocalTangent : Integrator::GreatCircle,
+                         reanchorKm);
+    sender.setAdaptiveRates(adaptiveRates, budget);
+    sender.setChurnRate(churn);
+
+    if (shardWorker) {
+        ShardAssignment assignment;
+        assignment.index = shardIndex;
+        assignment.count = shardCount;
+        assignment.mode = shardMode == "id" ? ShardMode::IdRange : ShardMode::Region;
+        sender.setShardAssignment(assignment);
+    }
+
+    // Per-entity console tables are unreadable for workers and large populations
+    if (shardWorker || scenario == "theatre" || offlineMode || churn > 0) {
+        sender.setLogging(verbose);
+    }
+
+    // Offline generation needs neither a socket nor the event loop
+    if (offlineMode) {
+        if (duration <= 0 || interval <= 0) {
+            std::cerr << "Duration and interval must be positive" << std::endl;
+            return 1;
+        }
+        sender.initializeSimulation(scenario);
+        return sender.runOffline(offlinePath, duration, interval, epochMs) ? 0 : 1;
+    }
 
     if (!serverMode) {
         if (autoReconnect) {
@@ -115,6 +326,14 @@ int main(int argc, char *argv[]) {
 
     // Setup based on mode
     if (serverMode) {
+        if (trackCapacity < 1 || trackHistory < 1) {
+            std::cerr << "Track store capacity and history must be positive" << std::endl;
+            return 1;
+        }
+
+        // Printing every message would cap ingest far below producer rates
+        sender.setLogging(verbose);
+        sender.configureTrackStore(trackCapacity, trackHistory);
         if (!sender.startServer(port)) {
             return 1;
         }
@@ -128,6 +347,15 @@ int main(int argc, char *argv[]) {
             sender.sendTestMessage(testMessage);
         });
         messageTimer.start();
+    } else if (pipeline) {
+        // Simulate and serialize run on their own threads; this loop only transmits
+        sender.connectToHost(host, port);
+        sender.initializeSimulation(scenario);
+        sender.startPipeline(interval, queueDepth);
+
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [&sender]() {
+            sender.stopPipeline();
+        });
     }  else {
         // Create a persistent timer (not a local variable)
         QTimer* updateTimer = new QTimer(&app);
@@ -1,10 +1,62 @@
 #include "networkedEWAM.h"
+#include "trackFile.h"
 #include <QJsonObject>
 #include <QJsonDocument>
 #include <QDateTime>
 #include <QTimer>
+#include <QHash>
+#include <QJsonArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <chrono>
 #include <iostream>
 #include <cmath>
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+// Longitude window split into bands when sharding by region
+static const double THEATRE_LON_MIN = 143.5;
+static const double THEATRE_LON_MAX = 146.5;
+static const double THEATRE_LAT_MIN = -38.8;
+static const double THEATRE_LAT_MAX = -36.8;
+
+// Adaptive update rates by priority class, boosted while manoeuvring
+static const double HIGH_PRIORITY_RATE_HZ = 1.0;
+static const double MED_PRIORITY_RATE_HZ = 0.5;
+static const double LOW_PRIORITY_RATE_HZ = 0.2;
+static const double MANOEUVRE_RATE_FACTOR = 4.0;
+
+// Scheduling class only; the priority sent on the wire is unaffected.
+// Fast movers get the most fidelity, large slow platforms the least.
+static double baseRateHz(const QString& type) {
+    if (type == "F35" || type == "F22") return HIGH_PRIORITY_RATE_HZ;
+    if (type == "P8" || type == "C17") return LOW_PRIORITY_RATE_HZ;
+    return MED_PRIORITY_RATE_HZ;
+}
+
+static const char* ENTITY_TYPES[] = {"F35", "F22", "E7", "P8", "C17"};
+
+// Raises a shared maximum without taking a lock
+static void recordMax(std::atomic<qint64>& maximum, qint64 value) {
+    qint64 current = maximum.load(std::memory_order_relaxed);
+    while (value > current && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+// Resident set size in MB, for soak runs; 0 where /proc is unavailable
+static double residentMb() {
+#ifdef Q_OS_LINUX
+    QFile statm("/proc/self/statm");
+    if (statm.open(QIODevice::ReadOnly)) {
+        QList<QByteArray> fields = statm.readAll().split(' ');
+        if (fields.size() > 1) {
+            return fields[1].toLongLong() * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+        }
+    }
+#endif
+    return 0.0;
+}
 
 NetworkedEWAM::NetworkedEWAM(QObject *parent)
     : QObject(parent)
@@ -13,16 +65,72 @@ NetworkedEWAM::NetworkedEWAM(QObject *parent)
     , reconnectInterval(5000)  // 5 seconds default
     , reconnectAttempts(0)
     , autoReconnect(true)
+    , server(nullptr)
+    , ingestStatsTimer(new QTimer(this))
+    , ingestedSinceReport(0)
+    , oversizedLines(0)
+    , tickCount(0)
+    , randomSeed(QDateTime::currentMSecsSinceEpoch())
+    , entityCount(1000)
+    , logging(true)
+    , simTimeMs(QDateTime::currentMSecsSinceEpoch())
+    , trackWriter(nullptr)
+    , adaptiveRates(false)
+    , rateStatsTimer(new QTimer(this))
+    , integrator(Integrator::GreatCircle)
+    , reanchorToleranceKm(5.0)
+    , churnPerSecond(0)
+    , churnCarry(0)
+    , churnSerial(0)
+    , churnStatsTimer(new QTimer(this))
+    , spawnedCount(0)
+    , despawnedCount(0)
+    , churnTicks(0)
+    , churnTickTotalUs(0)
+    , churnTickMaxUs(0)
+    , liveEntities(0)
+    , entitySlots(0)
+    , freeEntitySlots(0)
+    , pipelineActive(false)
+    , pipelineRunning(false)
+    , linkUp(false)
+    , drainScheduled(false)
+    , outboundSequence(0)
+    , tickOutputOpen(true)
+    , adoptRetryTimer(new QTimer(this))
+    , pipelineStatsTimer(new QTimer(this))
+    , droppedFrames(0)
+    , droppedWrites(0)
+    , heldTicks(0)
+    , maxTickLatenessUs(0)
+    , maxTickDurationUs(0)
 {
     connect(socket, &QTcpSocket::connected, this, &NetworkedEWAM::onConnected);
     connect(socket, &QTcpSocket::disconnected, this, &NetworkedEWAM::onDisconnected);
+    connect(socket, &QTcpSocket::readyRead, this, &NetworkedEWAM::onSocketReadyRead);
     connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QTcpSocket::error),
             this, &NetworkedEWAM::onError);
 
     connect(reconnectTimer, &QTimer::timeout, this, &NetworkedEWAM::tryReconnect);
+    connect(pipelineStatsTimer, &QTimer::timeout, this, &NetworkedEWAM::reportPipelineStats);
+    adoptRetryTimer->setSingleShot(true);
+    connect(adoptRetryTimer, &QTimer::timeout, this, &NetworkedEWAM::offerAdoptions);
+    connect(ingestStatsTimer, &QTimer::timeout, this, &NetworkedEWAM::reportIngestStats);
+    connect(rateStatsTimer, &QTimer::timeout, this, &NetworkedEWAM::reportRateStats);
+    connect(churnStatsTimer, &QTimer::timeout, this, &NetworkedEWAM::reportChurnStats);
 
     // Initialize random seed
-    qsrand(QDateTime::currentMSecsSinceEpoch());
+    qsrand(randomSeed);
+}
+
+void NetworkedEWAM::setRandomSeed(uint seed) {
+    randomSeed = seed;
+    qsrand(seed);
+}
+
+void NetworkedEWAM::setIntegrator(Integrator mode, double toleranceKm) {
+    integrator = mode;
+    reanchorToleranceKm = toleranceKm;
 }
 
 void NetworkedEWAM::connectToHost(const QString& host, quint16 port) {
@@ -38,10 +146,17 @@ void NetworkedEWAM::onConnected() {
     std::cout << "Connected to server" << std::endl;
     reconnectTimer->stop();
     reconnectAttempts = 0;
+    linkUp = true;
+
+    // Let the aggregator know which shard this stream belongs to
+    if (isSharded()) {
+        sendJson(shardControl("hello", QJsonObject()));
+    }
 }
 
 void NetworkedEWAM::onDisconnected() {
     std::cout << "Disconnected from server" << std::endl;
+    linkUp = false;
     if (autoReconnect && reconnectAttempts < MAX_RECONNECT_ATTEMPTS) {
         reconnectTimer->start(reconnectInterval);
     }
@@ -94,7 +209,27 @@ bool NetworkedEWAM::sendJson(const QJsonObject& json) {
     return socket->flush();
 }
 
+bool NetworkedEWAM::queueJson(const QJsonObject& json, bool closesTick) {
+    if (trackWriter) {
+        return true;
+    }
+
+    if (!pipelineActive) {
+        return sendJson(json);
+    }
+
+    OutboundRecord* record = claimControlRecord(closesTick);
+    if (!record) {
+        return false;
+    }
+    record->kind = OutboundRecord::Control;
+    record->control = json;
+    controlQueue->publish();
+    return true;
+}
+
 NetworkedEWAM::~NetworkedEWAM() {
+    stopPipeline();
 }
 
 void NetworkedEWAM::initializeSimulation(const QString& scenario) {
@@ -139,28 +274,57 @@ void NetworkedEWAM::initializeSimulation(const QString& scenario) {
         createSimulatedEntity("TEST01", "F35", -37.814, 144.963, 30000);
         createSimulatedEmitter("TEST_RADAR", "RADAR", "TA", -37.804, 144.953);
     }
+    else if (scenario == "theatre") {
+        // Large population spread across the theatre window for scaling runs
+        entities.reserve(entityCount);
+        for (int i = 0; i < entityCount; ++i) {
+            QString id = QString("TH%1").arg(i + 1, 7, 10, QChar('0'));
+            double lat = THEATRE_LAT_MIN + (qrand() % 10000) / 10000.0 * (THEATRE_LAT_MAX - THEATRE_LAT_MIN);
+            double lon = THEATRE_LON_MIN + (qrand() % 10000) / 10000.0 * (THEATRE_LON_MAX - THEATRE_LON_MIN);
+            createSimulatedEntity(id, ENTITY_TYPES[i % 5], lat, lon, 20000 + (qrand() % 20000));
+        }
+    }
+
+    // Every worker generates the same scenario from the shared seed, so only
+    // diverge the random streams once the population has been split
+    if (isSharded()) {
+        qsrand(randomSeed + shard.index + 1);
+    }
 }
 
 void NetworkedEWAM::updateSimulation(int deltaMs) {
     static QDateTime lastLogTime = QDateTime::currentDateTime();
     const double deltaHours = deltaMs / (1000.0 * 60.0 * 60.0);
+    std::chrono::steady_clock::time_point tickStart = std::chrono::steady_clock::now();
+    ++tickCount;
+    simTimeMs += deltaMs;
+
+    // A full control queue means the serialize stage is stalled. Hold back this
+    // tick's output entirely rather than send lines without their tick marker.
+    tickOutputOpen = !pipelineActive || controlQueue->claim() != nullptr;
+    if (!tickOutputOpen) {
+        heldTicks.fetch_add(1, std::memory_order_relaxed);
+    }
+    drainAdoptions();
 
     // Log header every update
-    std::cout << "\n" << QString(80, '-').toStdString() << std::endl;
-    std::cout << "ID       TYPE   LAT        LON        ALT     SPD     HDG" << std::endl;
-    std::cout << QString(80, '-').toStdString() << std::endl;
-    lastLogTime = QDateTime::currentDateTime();
+    if (logging) {
+        std::cout << "\n" << QString(80, '-').toStdString() << std::endl;
+        std::cout << "ID       TYPE   LAT        LON        ALT     SPD     HDG" << std::endl;
+        std::cout << QString(80, '-').toStdString() << std::endl;
+        lastLogTime = QDateTime::currentDateTime();
+    }
 
-    // Update each entity
-    for (auto it = entities.begin(); it != entities.end(); ++it) {
-        SimulatedEntity& entity = it.value();
+    if (churnPerSecond > 0) {
+        applyChurn(deltaMs);
+    }
 
-        // Store old values for change detection
-        double oldLat = entity.lat;
-        double oldLon = entity.lon;
-        double oldAlt = entity.altitude;
-        double oldSpd = entity.speed;
-        double oldHdg = entity.heading;
+    // Update each entity
+    for (int slot = 0; slot < entities.slotCount(); ++slot) {
+        if (!entities.isLive(slot)) {
+            continue;
+        }
+        SimulatedEntity& entity = entities.at(slot);
 
         // Update position
         double distance = entity.speed * deltaHours;
@@ -173,6 +337,63 @@ void NetworkedEWAM::updateSimulation(int deltaMs) {
             setNewTargets(entity);
         }
 
+        // Without the scheduler every entity goes out every tick
+        if (!adaptiveRates) {
+            emitEntity(entity);
+        }
+
+        // Entities that flew out of this shard's region move to their new owner.
+        // Ownership by id never changes, so only region shards project here.
+        if (isSharded() && shard.mode == ShardMode::Region) {
+            syncPosition(entity);
+            // Keep the entity another tick if its handoff could not be sent
+            if (!ownsPosition(entity.id, entity.lon) &&
+                handOffEntity(entity, shardFor(entity.id, entity.lon, shard))) {
+                entities.remove(entities.handleAt(slot));
+            }
+        }
+    }
+
+    if (adaptiveRates) {
+        emitDueEntities(deltaMs);
+    }
+
+    // Update emitters
+    for (auto it = emitters.begin(); it != emitters.end(); ++it) {
+        Emitter& emitter = it.value();
+
+        // Slowly rotate emitters in a circular pattern
+        double radius = 0.01;
+        double angle = simTimeMs / 10000.0;
+
+        emitter.lat = emitter.lat + radius * sin(angle);
+        emitter.lon = emitter.lon + radius * cos(angle);
+
+        sendEmitterUpdate(emitter);
+    }
+
+    // Close the tick so the aggregator can merge it with the other shards
+    if (isSharded()) {
+        QJsonObject json;
+        json["tick"] = static_cast<double>(tickCount);
+        queueJson(shardControl("tick", json), true);
+    }
+
+    qint64 tickUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - tickStart).count();
+    churnTicks.fetch_add(1, std::memory_order_relaxed);
+    churnTickTotalUs.fetch_add(tickUs, std::memory_order_relaxed);
+    recordMax(churnTickMaxUs, tickUs);
+    liveEntities.store(entities.size(), std::memory_order_relaxed);
+    entitySlots.store(entities.slotCount(), std::memory_order_relaxed);
+    freeEntitySlots.store(entities.freeCount(), std::memory_order_relaxed);
+}
+
+void NetworkedEWAM::emitEntity(SimulatedEntity& entity) {
+    // Bring lat/lon up to date before they are logged or emitted
+    syncPosition(entity);
+
+    if (logging) {
         // Format each field individually first
         QString latStr = QString("%1").arg(entity.lat, 9, 'f', 4);
         QString lonStr = QString("%1").arg(entity.lon, 9, 'f', 4);
@@ -180,12 +401,12 @@ void NetworkedEWAM::updateSimulation(int deltaMs) {
         QString spdStr = QString("%1").arg(entity.speed, 7, 'f', 0);
         QString hdgStr = QString("%1").arg(entity.heading, 6, 'f', 1);
 
-        // Add colors for changed values
-        if (fabs(entity.lat - oldLat) > 0.0001) latStr = "\033[32m" + latStr + "\033[0m";
-        if (fabs(entity.lon - oldLon) > 0.0001) lonStr = "\033[32m" + lonStr + "\033[0m";
-        if (fabs(entity.altitude - oldAlt) > 10) altStr = "\033[33m" + altStr + "\033[0m";
-        if (fabs(entity.speed - oldSpd) > 1) spdStr = "\033[36m" + spdStr + "\033[0m";
-        if (fabs(entity.heading - oldHdg) > 1) hdgStr = "\033[35m" + hdgStr + "\033[0m";
+        // Add colors for values changed since the entity was last shown
+        if (fabs(entity.lat - entity.shownLat) > 0.0001) latStr = "\033[32m" + latStr + "\033[0m";
+        if (fabs(entity.lon - entity.shownLon) > 0.0001) lonStr = "\033[32m" + lonStr + "\033[0m";
+        if (fabs(entity.altitude - entity.shownAlt) > 10) altStr = "\033[33m" + altStr + "\033[0m";
+        if (fabs(entity.speed - entity.shownSpeed) > 1) spdStr = "\033[36m" + spdStr + "\033[0m";
+        if (fabs(entity.heading - entity.shownHeading) > 1) hdgStr = "\033[35m" + hdgStr + "\033[0m";
 
         QString statusLine = entity.id + "\t " +
                            entity.type + "\t" +
@@ -196,26 +417,76 @@ void NetworkedEWAM::updateSimulation(int deltaMs) {
                            hdgStr;
 
         std::cout << statusLine.toStdString() << std::endl;
-        sendEntityUpdate(entity);
     }
 
-    // Update emitters
-    for (auto it = emitters.begin(); it != emitters.end(); ++it) {
-        Emitter& emitter = it.value();
+    entity.shownLat = entity.lat;
+    entity.shownLon = entity.lon;
+    entity.shownAlt = entity.altitude;
+    entity.shownSpeed = entity.speed;
+    entity.shownHeading = entity.heading;
 
-        // Slowly rotate emitters in a circular pattern
-        double radius = 0.01;
-        double angle = QDateTime::currentMSecsSinceEpoch() / 10000.0;
+    sendEntityUpdate(entity);
+}
 
-        emitter.lat = emitter.lat + radius * sin(angle);
-        emitter.lon = emitter.lon + radius * cos(angle);
+void NetworkedEWAM::emitDueEntities(int deltaMs) {
+    scheduler.refill(deltaMs);
 
-        sendEmitterUpdate(emitter);
+    // Emitters are never deferred, but they still count against the budget
+    scheduler.charge(emitters.size());
+
+    EntityHandle handle;
+    qint64 dueMs;
+    while (scheduler.popDue(simTimeMs, handle, dueMs)) {
+        // Entities handed off or despawned since leave stale handles behind,
+        // which are dropped without touching the budget
+        SimulatedEntity* entity = entities.get(handle);
+        if (!entity) {
+            continue;
+        }
+
+        scheduler.markSent(simTimeMs - dueMs);
+        emitEntity(*entity);
+        scheduler.schedule(handle, simTimeMs + updateIntervalMs(*entity));
     }
 }
 
-void NetworkedEWAM::createSimulatedEntity(const QString& id, const QString& type,
-                                         double lat, double lon, double altitude) {
+int NetworkedEWAM::updateIntervalMs(const SimulatedEntity& entity) const {
+    double rateHz = baseRateHz(entity.type);
+
+    // Turning, climbing or accelerating entities are worth more of the budget
+    if (fabs(entity.heading - entity.targetHeading) > 1.0 ||
+        fabs(entity.altitude - entity.targetAlt) > 100 ||
+        fabs(entity.speed - entity.targetSpeed) > 10) {
+        rateHz *= MANOEUVRE_RATE_FACTOR;
+    }
+
+    return qMax(1, static_cast<int>(1000.0 / rateHz));
+}
+
+void NetworkedEWAM::setAdaptiveRates(bool enabled, double budgetPerSecond) {
+    adaptiveRates = enabled;
+    scheduler.setBudget(budgetPerSecond);
+
+    if (enabled) {
+        rateStatsTimer->start(5000);
+    } else {
+        rateStatsTimer->stop();
+        scheduler.clear();
+    }
+}
+
+void NetworkedEWAM::reportRateStats() {
+    QString budget = scheduler.budget() > 0 ? QString::number(scheduler.budget(), 'f', 0) : QString("unlimited");
+    std::cout << QString("Adaptive rates: %1 entity msgs/s (budget %2) | max lateness %3 ms | %4 scheduled")
+                .arg(scheduler.takeReleased() / 5.0, 0, 'f', 0)
+                .arg(budget)
+                .arg(scheduler.takeMaxLatenessMs())
+                .arg(scheduler.pending())
+                .toStdString() << std::endl;
+}
+
+EntityHandle NetworkedEWAM::createSimulatedEntity(const QString& id, const QString& type,
+                                                 double lat, double lon, double altitude) {
     SimulatedEntity entity;
     entity.id = id;
     entity.type = type;
@@ -233,8 +504,22 @@ void NetworkedEWAM::createSimulatedEntity(const QString& id, const QString& type
     entity.targetAlt = altitude;
     entity.targetSpeed = entity.speed;
     entity.targetHeading = entity.heading;
+    Kinematics::anchorFrame(entity.frame, lat, lon);
+    entity.shownLat = lat;
+    entity.shownLon = lon;
+    entity.shownAlt = altitude;
+    entity.shownSpeed = entity.speed;
+    entity.shownHeading = entity.heading;
+
+    // Workers build the whole scenario but keep only their own share
+    if (!ownsPosition(id, lon)) {
+        return EntityHandle();
+    }
 
-    entities[id] = entity;
+    EntityHandle handle = insertEntity(entity);
+    if (!logging) {
+        return handle;
+    }
 
     // Print creation info with formatting
     std::cout << "\033[1m" << QString("Created %1 (%2)")
@@ -250,6 +535,121 @@ void NetworkedEWAM::createSimulatedEntity(const QString& id, const QString& type
                 .arg(entity.speed, 0, 'f', 0)
                 .arg(entity.heading, 0, 'f', 0)
                 .toStdString() << std::endl;
+    return handle;
+}
+
+EntityHandle NetworkedEWAM::insertEntity(const SimulatedEntity& entity) {
+    EntityHandle handle = entities.insert(entity);
+    if (adaptiveRates) {
+        scheduler.schedule(handle, simTimeMs);
+    }
+    return handle;
+}
+
+EntityHandle NetworkedEWAM::spawnEntity(const QString& id, const QString& type,
+                                        double lat, double lon, double altitude) {
+    EntityHandle handle = createSimulatedEntity(id, type, lat, lon, altitude);
+    if (entities.contains(handle)) {
+        spawnedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    return handle;
+}
+
+bool NetworkedEWAM::despawnEntity(EntityHandle handle) {
+    SimulatedEntity* entity = entities.get(handle);
+    if (!entity) {
+        return false;
+    }
+
+    // Consumers are told the track ended rather than left to watch it go stale;
+    // the entity stays until that can be queued
+    syncPosition(*entity);
+    if (!sendEntityRemoval(*entity)) {
+        return false;
+    }
+    if (logging) {
+        std::cout << "\033[1m" << QString("Removed %1 (%2)")
+                    .arg(entity->id)
+                    .arg(entity->type)
+                    .toStdString() << "\033[0m" << std::endl;
+    }
+
+    entities.remove(handle);
+    despawnedCount.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void NetworkedEWAM::setChurnRate(double perSecond) {
+    churnPerSecond = perSecond;
+    churnCarry = 0;
+
+    if (perSecond > 0) {
+        churnStatsTimer->start(10000);
+    } else {
+        churnStatsTimer->stop();
+    }
+}
+
+void NetworkedEWAM::applyChurn(int deltaMs) {
+    churnCarry += churnPerSecond * deltaMs / 1000.0;
+    int count = static_cast<int>(churnCarry);
+    churnCarry -= count;
+
+    // Newcomers appear inside this process's share of the theatre window
+    double lonMin = THEATRE_LON_MIN;
+    double lonMax = THEATRE_LON_MAX;
+    if (isSharded() && shard.mode == ShardMode::Region) {
+        double band = (THEATRE_LON_MAX - THEATRE_LON_MIN) / shard.count;
+        lonMin = THEATRE_LON_MIN + band * shard.index;
+        lonMax = lonMin + band;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        // Retire a random live entity, probing forward from a random slot
+        if (entities.size() > 0) {
+            int slots = entities.slotCount();
+            int slot = qrand() % slots;
+            while (!entities.isLive(slot)) {
+                slot = (slot + 1) % slots;
+            }
+            // Spawning without the matching despawn would grow the population
+            if (!despawnEntity(entities.handleAt(slot))) {
+                break;
+            }
+        }
+
+        // The half-step offset keeps lon off the band edges, which shardFor
+        // could otherwise floor into the neighbouring band
+        double lat = THEATRE_LAT_MIN + (qrand() % 10000) / 10000.0 * (THEATRE_LAT_MAX - THEATRE_LAT_MIN);
+        double lon = lonMin + (qrand() % 10000 + 0.5) / 10000.0 * (lonMax - lonMin);
+
+        // Ids are never reused, and carry the shard so workers cannot collide.
+        // Only id-range shards own by id, so only they need to look for one of theirs.
+        QString id = QString("CHN%1-%2").arg(shard.index).arg(++churnSerial);
+        if (isSharded() && shard.mode == ShardMode::IdRange) {
+            while (!ownsPosition(id, lon)) {
+                id = QString("CHN%1-%2").arg(shard.index).arg(++churnSerial);
+            }
+        }
+
+        spawnEntity(id, ENTITY_TYPES[churnSerial % 5], lat, lon, 20000 + (qrand() % 20000));
+    }
+}
+
+void NetworkedEWAM::reportChurnStats() {
+    quint64 ticks = churnTicks.exchange(0);
+    qint64 totalUs = churnTickTotalUs.exchange(0);
+    std::cout << QString("Churn: %1 spawned, %2 despawned | %3 live in %4 slots (%5 free)"
+                         " | tick avg %6 ms, max %7 ms | RSS %8 MB")
+                .arg(spawnedCount.exchange(0))
+                .arg(despawnedCount.exchange(0))
+                .arg(liveEntities.load(std::memory_order_relaxed))
+                .arg(entitySlots.load(std::memory_order_relaxed))
+                .arg(freeEntitySlots.load(std::memory_order_relaxed))
+                .arg(ticks > 0 ? totalUs / 1000.0 / ticks : 0.0, 0, 'f', 2)
+                .arg(churnTickMaxUs.exchange(0) / 1000.0, 0, 'f', 2)
+                .arg(residentMb(), 0, 'f', 1)
+                .toStdString() << std::endl;
 }
 
 void NetworkedEWAM::setNewTargets(SimulatedEntity& entity) {
@@ -271,9 +671,9 @@ void NetworkedEWAM::setNewTargets(SimulatedEntity& entity) {
     if (entity.targetHeading < 0) entity.targetHeading += 360;
 
     // Log significant changes
-    if (fabs(entity.targetAlt - oldAlt) > 100 ||
+    if (logging && (fabs(entity.targetAlt - oldAlt) > 100 ||
         fabs(entity.targetSpeed - oldSpd) > 10 ||
-        fabs(entity.targetHeading - oldHdg) > 5) {
+        fabs(entity.targetHeading - oldHdg) > 5)) {
 
         std::cout << QString("  %1 adjusting course:")
                     .arg(entity.id)
@@ -313,27 +713,33 @@ void NetworkedEWAM::createSimulatedEmitter(const QString& id, const QString& typ
         true, true, false, false,       // capability flags
         false                           // jam
     );
+    if (!ownsPosition(id, lon)) {
+        return;
+    }
+
     emitters[id] = emitter;
     std::cout << "Created emitter: " << id.toStdString() << " (" << type.toStdString() << ")" << std::endl;
 }
 
 void NetworkedEWAM::updatePosition(SimulatedEntity& entity, double distanceKm) {
-    const double R = 6371.0; // Earth radius in km
-
-    double lat1 = entity.lat * M_PI / 180;
-    double lon1 = entity.lon * M_PI / 180;
-    double bearing = entity.heading * M_PI / 180;
+    if (integrator == Integrator::LocalTangent) {
+        Kinematics::advanceLocalTangent(entity.frame, entity.heading, distanceKm);
 
-    double angular_distance = distanceKm / R;
-
-    double lat2 = asin(sin(lat1) * cos(angular_distance) +
-                      cos(lat1) * sin(angular_distance) * cos(bearing));
+        // Keep the flat-earth error bounded by moving the origin along with the entity
+        if (Kinematics::frameDrifted(entity.frame, reanchorToleranceKm)) {
+            Kinematics::projectFrame(entity.frame, entity.lat, entity.lon);
+            Kinematics::anchorFrame(entity.frame, entity.lat, entity.lon);
+        }
+        return;
+    }
 
-    double lon2 = lon1 + atan2(sin(bearing) * sin(angular_distance) * cos(lat1),
-                              cos(angular_distance) - sin(lat1) * sin(lat2));
+    Kinematics::advanceGreatCircle(entity.lat, entity.lon, entity.heading, distanceKm);
+}
 
-    entity.lat = lat2 * 180 / M_PI;
-    entity.lon = lon2 * 180 / M_PI;
+void NetworkedEWAM::syncPosition(SimulatedEntity& entity) {
+    if (integrator == Integrator::LocalTangent) {
+        Kinematics::projectFrame(entity.frame, entity.lat, entity.lon);
+    }
 }
 
 void NetworkedEWAM::updateDynamics(SimulatedEntity& entity, int deltaMs) {
@@ -369,7 +775,7 @@ void NetworkedEWAM::updateDynamics(SimulatedEntity& entity, int deltaMs) {
     }
 }
 
-void NetworkedEWAM::sendEntityUpdate(const SimulatedEntity& entity) {
+static QJsonObject entityToJson(const SimulatedEntity& entity) {
     QJsonObject json;
     json["id"] = entity.id;
     json["type"] = entity.type;
@@ -385,10 +791,19 @@ void NetworkedEWAM::sendEntityUpdate(const SimulatedEntity& entity) {
     json["state"] = "active";
     json["apd"] = entity.priority;  // Using priority as APD for simplicity
 
-    sendJson(json);
+    return json;
 }
 
-void NetworkedEWAM::sendEmitterUpdate(const Emitter& emitter) {
+static QJsonObject removalToJson(const SimulatedEntity& entity) {
+    QJsonObject json;
+    json["id"] = entity.id;
+    json["type"] = entity.type;
+    json["state"] = "removed";
+
+    return json;
+}
+
+static QJsonObject emitterToJson(const Emitter& emitter) {
     QJsonObject json;
     json["id"] = emitter.id;
     json["type"] = emitter.type;
@@ -411,7 +826,510 @@ void NetworkedEWAM::sendEmitterUpdate(const Emitter& emitter) {
     json["jamIneffective"] = emitter.jamIneffective;
     json["jamEffective"] = emitter.jamEffective;
 
-    sendJson(json);
+    return json;
+}
+
+void NetworkedEWAM::sendEntityUpdate(const SimulatedEntity& entity) {
+    if (trackWriter) {
+        trackWriter->appendEntity(simTimeMs, entity);
+        return;
+    }
+
+    if (!pipelineActive) {
+        sendJson(entityToJson(entity));
+        return;
+    }
+
+    OutboundRecord* record = claimRecord();
+    if (record) {
+        record->kind = OutboundRecord::Entity;
+        record->entity = entity;
+        frameQueue->publish();
+    }
+}
+
+bool NetworkedEWAM::sendEntityRemoval(const SimulatedEntity& entity) {
+    if (trackWriter) {
+        trackWriter->appendEntity(simTimeMs, entity, TrackFileWriter::Removed);
+        return true;
+    }
+
+    if (!pipelineActive) {
+        sendJson(removalToJson(entity));
+        return true;
+    }
+
+    // A lost removal would leave the consumer's track open forever
+    OutboundRecord* record = claimControlRecord(false);
+    if (!record) {
+        return false;
+    }
+    record->kind = OutboundRecord::EntityRemoved;
+    record->entity = entity;
+    controlQueue->publish();
+    return true;
+}
+
+void NetworkedEWAM::sendEmitterUpdate(const Emitter& emitter) {
+    if (trackWriter) {
+        trackWriter->appendEmitter(simTimeMs, emitter);
+        return;
+    }
+
+    if (!pipelineActive) {
+        sendJson(emitterToJson(emitter));
+        return;
+    }
+
+    OutboundRecord* record = claimRecord();
+    if (record) {
+        record->kind = OutboundRecord::EmitterState;
+        record->emitter = emitter;
+        frameQueue->publish();
+    }
+}
+
+// Offline functions
+
+bool NetworkedEWAM::runOffline(const QString& path, double durationS, int stepMs, qint64 startMs) {
+    TrackFileWriter writer;
+    if (!writer.open(path)) {
+        return false;
+    }
+
+    // A fixed start keeps the timestamps, and with --seed the whole file, repeatable
+    simTimeMs = startMs;
+
+    const qint64 steps = static_cast<qint64>(durationS * 1000.0 / stepMs);
+    std::cout << "Generating " << durationS << "s of simulated time in " << steps
+              << " steps into " << path.toStdString() << std::endl;
+
+    trackWriter = &writer;
+    QElapsedTimer wallClock;
+    wallClock.start();
+    qint64 lastReportMs = 0;
+    quint64 lastReportRows = 0;
+
+    for (qint64 step = 0; step < steps; ++step) {
+        updateSimulation(stepMs);
+
+        qint64 elapsedMs = wallClock.elapsed();
+        if (elapsedMs - lastReportMs >= 5000) {
+            quint64 rows = writer.entityRowsWritten();
+            std::cout << QString("  %1/%2 steps | %3 entity-updates/s | %4 MB written")
+                        .arg(step + 1)
+                        .arg(steps)
+                        .arg((rows - lastReportRows) * 1000.0 / (elapsedMs - lastReportMs), 0, 'f', 0)
+                        .arg(writer.bytesWritten() / (1024.0 * 1024.0), 0, 'f', 1)
+                        .toStdString() << std::endl;
+            lastReportMs = elapsedMs;
+            lastReportRows = rows;
+        }
+    }
+
+    trackWriter = nullptr;
+    quint64 rows = writer.rowsWritten();
+    quint64 entityRows = writer.entityRowsWritten();
+    bool ok = writer.close();
+
+    double elapsedS = qMax<qint64>(wallClock.elapsed(), 1) / 1000.0;
+    std::cout << QString("Wrote %1 entity and %2 emitter updates in %3 s (%4 entity-updates/s, %5x real time)")
+                .arg(entityRows)
+                .arg(rows - entityRows)
+                .arg(elapsedS, 0, 'f', 2)
+                .arg(entityRows / elapsedS, 0, 'f', 0)
+                .arg(durationS / elapsedS, 0, 'f', 1)
+                .toStdString() << std::endl;
+    return ok;
+}
+
+// Pipeline functions
+
+// Back off progressively while a queue stays empty or full
+static void idleWait(int& idleRounds) {
+    if (++idleRounds < 64) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+void NetworkedEWAM::startPipeline(int intervalMs, int queueDepth) {
+    if (pipelineActive) {
+        return;
+    }
+
+    frameQueue.reset(new SpscRing<OutboundRecord>(queueDepth));
+    controlQueue.reset(new SpscRing<OutboundRecord>(queueDepth));
+    wireQueue.reset(new SpscRing<QByteArray>(queueDepth));
+    // Room for the whole population crossing at once; anything past that waits in
+    // pendingAdoptions and is offered again a tick later
+    adoptQueue.reset(new SpscRing<QJsonObject>(qMax(256, entityCount)));
+    adoptRetryTimer->setInterval(intervalMs);
+
+    // Resume draining as soon as the socket has room again
+    connect(socket, &QTcpSocket::bytesWritten, this, &NetworkedEWAM::drainWireQueue);
+
+    pipelineActive = true;
+    pipelineRunning = true;
+    simulateThread = std::thread(&NetworkedEWAM::simulateLoop, this, intervalMs);
+    serializeThread = std::thread(&NetworkedEWAM::serializeLoop, this);
+    pipelineStatsTimer->start(5000);
+
+    std::cout << "Pipeline started (queue depth " << frameQueue->capacity() << ")" << std::endl;
+}
+
+void NetworkedEWAM::stopPipeline() {
+    if (!pipelineActive) {
+        return;
+    }
+
+    pipelineRunning = false;
+    if (simulateThread.joinable()) simulateThread.join();
+    if (serializeThread.joinable()) serializeThread.join();
+    pipelineStatsTimer->stop();
+    adoptRetryTimer->stop();
+    disconnect(socket, &QTcpSocket::bytesWritten, this, &NetworkedEWAM::drainWireQueue);
+    pipelineActive = false;
+
+    // The entities are back on this thread; take in whatever handoffs were still waiting
+    while (QJsonObject* json = adoptQueue->front()) {
+        adoptEntity(*json);
+        adoptQueue->pop();
+    }
+    while (!pendingAdoptions.isEmpty()) {
+        adoptEntity(pendingAdoptions.takeFirst());
+    }
+}
+
+OutboundRecord* NetworkedEWAM::claimRecord() {
+    // Never block the tick on a slow consumer; count what had to be shed instead
+    OutboundRecord* record = tickOutputOpen ? frameQueue->claim() : nullptr;
+    if (!record) {
+        droppedFrames.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    record->sequence = outboundSequence++;
+    return record;
+}
+
+OutboundRecord* NetworkedEWAM::claimControlRecord(bool closesTick) {
+    // Handoffs, tick markers and removals are never shed and never waited for.
+    // When there is no room the caller keeps the entity and tries again next tick.
+    // The last slot belongs to the tick marker, which the start of the tick
+    // already checked was free.
+    if (!tickOutputOpen) {
+        return nullptr;
+    }
+    OutboundRecord* record = controlQueue->claim(closesTick ? 0 : 1);
+    if (record) {
+        record->sequence = outboundSequence++;
+    }
+    return record;
+}
+
+void NetworkedEWAM::drainAdoptions() {
+    if (!pipelineActive) {
+        return;
+    }
+
+    while (QJsonObject* json = adoptQueue->front()) {
+        adoptEntity(*json);
+        adoptQueue->pop();
+    }
+}
+
+void NetworkedEWAM::simulateLoop(int intervalMs) {
+    typedef std::chrono::steady_clock Clock;
+
+    // qrand state is per thread
+    qsrand(randomSeed + shard.index + 1);
+
+    const std::chrono::milliseconds interval(intervalMs);
+    Clock::time_point nextTick = Clock::now() + interval;
+
+    while (pipelineRunning.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_until(nextTick);
+
+        Clock::time_point start = Clock::now();
+        recordMax(maxTickLatenessUs,
+                  std::chrono::duration_cast<std::chrono::microseconds>(start - nextTick).count());
+
+        if (linkUp.load(std::memory_order_acquire)) {
+            updateSimulation(intervalMs);
+        }
+
+        Clock::time_point end = Clock::now();
+        recordMax(maxTickDurationUs,
+                  std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+
+        // An overrun skips the missed ticks rather than bursting to catch up
+        nextTick += interval;
+        while (nextTick <= end) {
+            nextTick += interval;
+        }
+    }
+}
+
+void NetworkedEWAM::serializeLoop() {
+    int idleRounds = 0;
+
+    while (pipelineRunning.load(std::memory_order_acquire)) {
+        // Take whichever queue holds the older record. Reading the frame queue
+        // first, and again when it looked empty, makes every frame older than the
+        // control record visible, so sequence order is the simulate stage's order.
+        OutboundRecord* frame = frameQueue->front();
+        OutboundRecord* control = controlQueue->front();
+        if (!frame && control) {
+            frame = frameQueue->front();
+        }
+        bool fromControl = control && (!frame || control->sequence < frame->sequence);
+        OutboundRecord* record = fromControl ? control : frame;
+        if (!record) {
+            idleWait(idleRounds);
+            continue;
+        }
+
+        // A full wire queue leaves records waiting here, which in turn makes
+        // the simulate stage shed updates instead of slowing down
+        QByteArray* data = wireQueue->claim();
+        if (!data) {
+            idleWait(idleRounds);
+            continue;
+        }
+        idleRounds = 0;
+
+        QJsonObject json;
+        switch (record->kind) {
+        case OutboundRecord::Entity:
+            json = entityToJson(record->entity);
+            break;
+        case OutboundRecord::EntityRemoved:
+            json = removalToJson(record->entity);
+            break;
+        case OutboundRecord::EmitterState:
+            json = emitterToJson(record->emitter);
+            break;
+        case OutboundRecord::Control:
+            json = record->control;
+            break;
+        }
+        if (fromControl) {
+            controlQueue->pop();
+        } else {
+            frameQueue->pop();
+        }
+
+        *data = QJsonDocument(json).toJson(QJsonDocument::Compact);
+        data->append('\n');
+        wireQueue->publish();
+        scheduleDrain();
+    }
+}
+
+void NetworkedEWAM::scheduleDrain() {
+    // One queued call at a time is enough; the drain empties everything available
+    if (!drainScheduled.exchange(true)) {
+        QMetaObject::invokeMethod(this, "drainWireQueue", Qt::QueuedConnection);
+    }
+}
+
+void NetworkedEWAM::drainWireQueue() {
+    if (!pipelineActive) {
+        return;
+    }
+    drainScheduled = false;
+
+    bool wrote = false;
+    size_t budget = wireQueue->capacity();
+    while (budget-- > 0) {
+        // Leave the rest queued until the kernel has taken what we already gave it
+        if (socket->bytesToWrite() > MAX_SOCKET_BACKLOG) {
+            break;
+        }
+
+        QByteArray* data = wireQueue->front();
+        if (!data) {
+            break;
+        }
+
+        if (isConnected() && socket->write(*data) != -1) {
+            wrote = true;
+        } else {
+            droppedWrites.fetch_add(1, std::memory_order_relaxed);
+        }
+        wireQueue->pop();
+    }
+
+    if (wrote) {
+        socket->flush();
+    }
+    if (wireQueue->front() && socket->bytesToWrite() <= MAX_SOCKET_BACKLOG) {
+        scheduleDrain();
+    }
+}
+
+PipelineStats NetworkedEWAM::pipelineStats() {
+    PipelineStats stats;
+    stats.frameQueueDepth = frameQueue ? frameQueue->size() : 0;
+    stats.frameQueueCapacity = frameQueue ? frameQueue->capacity() : 0;
+    stats.controlQueueDepth = controlQueue ? controlQueue->size() : 0;
+    stats.controlQueueCapacity = controlQueue ? controlQueue->capacity() : 0;
+    stats.wireQueueDepth = wireQueue ? wireQueue->size() : 0;
+    stats.wireQueueCapacity = wireQueue ? wireQueue->capacity() : 0;
+    stats.droppedFrames = droppedFrames.load(std::memory_order_relaxed);
+    stats.droppedWrites = droppedWrites.load(std::memory_order_relaxed);
+    stats.heldTicks = heldTicks.load(std::memory_order_relaxed);
+    stats.maxTickLatenessMs = maxTickLatenessUs.exchange(0) / 1000.0;
+    stats.maxTickDurationMs = maxTickDurationUs.exchange(0) / 1000.0;
+    return stats;
+}
+
+void NetworkedEWAM::reportPipelineStats() {
+    PipelineStats stats = pipelineStats();
+    std::cout << QString("Pipeline: frames %1/%2 | control %3/%4 | wire %5/%6"
+                         " | dropped %7 frames, %8 writes | held %9 ticks"
+                         " | tick late max %10 ms, tick max %11 ms")
+                .arg(stats.frameQueueDepth)
+                .arg(stats.frameQueueCapacity)
+                .arg(stats.controlQueueDepth)
+                .arg(stats.controlQueueCapacity)
+                .arg(stats.wireQueueDepth)
+                .arg(stats.wireQueueCapacity)
+                .arg(stats.droppedFrames)
+                .arg(stats.droppedWrites)
+                .arg(stats.heldTicks)
+                .arg(stats.maxTickLatenessMs, 0, 'f', 2)
+                .arg(stats.maxTickDurationMs, 0, 'f', 2)
+                .toStdString() << std::endl;
+}
+
+// Shard worker functions
+
+int NetworkedEWAM::shardFor(const QString& id, double lon, const ShardAssignment& assignment) {
+    if (assignment.count <= 1) {
+        return 0;
+    }
+
+    if (assignment.mode == ShardMode::IdRange) {
+        return static_cast<int>(qHash(id) % static_cast<uint>(assignment.count));
+    }
+
+    double fraction = (lon - THEATRE_LON_MIN) / (THEATRE_LON_MAX - THEATRE_LON_MIN);
+    int index = static_cast<int>(floor(fraction * assignment.count));
+    return qBound(0, index, assignment.count - 1);
+}
+
+bool NetworkedEWAM::ownsPosition(const QString& id, double lon) const {
+    return shardFor(id, lon, shard) == shard.index;
+}
+
+QJsonObject NetworkedEWAM::shardControl(const QString& kind, QJsonObject json) const {
+    json["ctl"] = kind;
+    json["shard"] = shard.index;
+    return json;
+}
+
+bool NetworkedEWAM::handOffEntity(const SimulatedEntity& entity, int toShard) {
+    // Carries the full kinematic state so the new owner continues seamlessly
+    QJsonObject json;
+    json["toShard"] = toShard;
+    json["id"] = entity.id;
+    json["type"] = entity.type;
+    json["lat"] = entity.lat;
+    json["lon"] = entity.lon;
+    json["altitude"] = entity.altitude;
+    json["speed"] = entity.speed;
+    json["heading"] = entity.heading;
+    json["turnRate"] = entity.turnRate;
+    json["climbRate"] = entity.climbRate;
+    json["priority"] = entity.priority;
+    json["jam"] = entity.jam;
+    json["category"] = static_cast<int>(entity.category);
+    json["targetAlt"] = entity.targetAlt;
+    json["targetSpeed"] = entity.targetSpeed;
+    json["targetHeading"] = entity.targetHeading;
+
+    return queueJson(shardControl("handoff", json));
+}
+
+void NetworkedEWAM::adoptEntity(const QJsonObject& json) {
+    SimulatedEntity entity;
+    entity.id = json["id"].toString();
+    entity.type = json["type"].toString();
+    entity.lat = json["lat"].toDouble();
+    entity.lon = json["lon"].toDouble();
+    entity.altitude = json["altitude"].toDouble();
+    entity.speed = json["speed"].toDouble();
+    entity.heading = json["heading"].toDouble();
+    entity.turnRate = json["turnRate"].toDouble();
+    entity.climbRate = json["climbRate"].toDouble();
+    entity.priority = json["priority"].toString();
+    entity.jam = json["jam"].toBool();
+    entity.category = static_cast<PE::PECategory>(json["category"].toInt());
+    entity.targetAlt = json["targetAlt"].toDouble();
+    entity.targetSpeed = json["targetSpeed"].toDouble();
+    entity.targetHeading = json["targetHeading"].toDouble();
+    Kinematics::anchorFrame(entity.frame, entity.lat, entity.lon);
+    entity.shownLat = entity.lat;
+    entity.shownLon = entity.lon;
+    entity.shownAlt = entity.altitude;
+    entity.shownSpeed = entity.speed;
+    entity.shownHeading = entity.heading;
+
+    insertEntity(entity);
+}
+
+void NetworkedEWAM::onSocketReadyRead() {
+    // Only shard workers expect anything back; drain echoed data otherwise
+    if (!isSharded()) {
+        socket->readAll();
+        return;
+    }
+
+    while (socket->canReadLine()) {
+        QJsonDocument doc = QJsonDocument::fromJson(socket->readLine());
+        if (doc.isNull() || !doc.isObject()) {
+            continue;
+        }
+
+        QJsonObject json = doc.object();
+        if (json["ctl"].toString() != "handoff" || json["toShard"].toInt() != shard.index) {
+            continue;
+        }
+
+        // The simulate thread owns the entities while the pipeline runs
+        if (!pipelineActive) {
+            adoptEntity(json);
+            continue;
+        }
+
+        pendingAdoptions.append(json);
+    }
+
+    if (pipelineActive) {
+        offerAdoptions();
+    }
+}
+
+void NetworkedEWAM::offerAdoptions() {
+    if (!pipelineActive) {
+        return;
+    }
+
+    // Handoffs are never dropped: whatever does not fit now is kept in order for the next tick
+    while (!pendingAdoptions.isEmpty()) {
+        QJsonObject* slot = adoptQueue->claim();
+        if (!slot) {
+            break;
+        }
+        *slot = pendingAdoptions.takeFirst();
+        adoptQueue->publish();
+    }
+
+    if (!pendingAdoptions.isEmpty() && !adoptRetryTimer->isActive()) {
+        adoptRetryTimer->start();
+    }
 }
 
 
@@ -429,10 +1347,23 @@ bool NetworkedEWAM::startServer(quint16 port) {
         return false;
     }
 
+    if (!tracks) {
+        configureTrackStore(16384, 16);
+    }
+    buffer.resize(MAX_LINE_LENGTH);
+    ingestClock.start();
+    ingestStatsTimer->start(5000);
+
     std::cout << "Server listening on port " << port << std::endl;
     return true;
 }
 
+void NetworkedEWAM::configureTrackStore(int capacity, int historyLength) {
+    tracks.reset(new TrackStore(capacity, historyLength));
+    std::cout << "Track store: " << capacity << " ids, " << historyLength
+              << " samples of history each" << std::endl;
+}
+
 void NetworkedEWAM::stopServer() {
     if (server) {
         server->close();
@@ -459,16 +1390,37 @@ void NetworkedEWAM::onReadyRead() {
     QTcpSocket* clientSocket = qobject_cast<QTcpSocket*>(sender());
     if (!clientSocket) return;
 
-    while (clientSocket->bytesAvailable() > 0) {
-        QByteArray data = clientSocket->readLine();
-        if (!data.isEmpty()) {
-            handleReceivedData(data);
+    // Partial lines stay buffered in the socket until the rest arrives;
+    // whole ones are read into the same buffer every time
+    bool echoed = false;
+    while (clientSocket->canReadLine()) {
+        qint64 length = clientSocket->readLine(buffer.data(), buffer.size());
+        if (length <= 0) {
+            break;
+        }
 
+        // Nothing we ingest is this long; discard the rest of the line
+        if (buffer[static_cast<int>(length - 1)] != '\n') {
+            qint64 more;
+            do {
+                more = clientSocket->readLine(buffer.data(), buffer.size());
+            } while (more > 0 && buffer[static_cast<int>(more - 1)] != '\n');
+            ++oversizedLines;
+            continue;
+        }
+
+        if (handleReceivedData(clientSocket, buffer.constData(), static_cast<int>(length))) {
             // Echo back to all clients in server mode
             for (QTcpSocket* client : clients) {
-                client->write(data);
-                client->flush();
+                client->write(buffer.constData(), length);
             }
+            echoed = true;
+        }
+    }
+
+    if (echoed) {
+        for (QTcpSocket* client : clients) {
+            client->flush();
         }
     }
 }
@@ -482,22 +1434,128 @@ void NetworkedEWAM::onClientDisconnected() {
     std::cout << "Client disconnected. Remaining clients: " << clients.size() << std::endl;
 }
 
-void NetworkedEWAM::handleReceivedData(const QByteArray& data) {
-    std::cout << "Received: " << QString(data).trimmed().toStdString() << std::endl;
+bool NetworkedEWAM::handleReceivedData(QTcpSocket* client, const char* data, int length) {
+    if (logging) {
+        std::cout << "Received: " << QByteArray(data, length).trimmed().toStdString() << std::endl;
+    }
 
-    try {
-        QJsonDocument doc = QJsonDocument::fromJson(data);
-        if (!doc.isNull() && doc.isObject()) {
-            QJsonObject json = doc.object();
-            // Process received JSON data
-            if (json.contains("id")) {
-                std::cout << "Received entity/emitter update for ID: "
-                         << json["id"].toString().toStdString() << std::endl;
-            }
+    // Updates are parsed in place; only the rare queries pay for a full JSON parse
+    TrackLine fields;
+    if (!parseTrackLine(data, length, fields)) {
+        return true;
+    }
+
+    // Queries are answered to the asking client only
+    if (fields.query) {
+        QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromRawData(data, length));
+        if (doc.isObject()) {
+            QJsonObject reply = answerQuery(doc.object());
+            client->write(QJsonDocument(reply).toJson(QJsonDocument::Compact) + "\n");
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Error processing received data: " << e.what() << std::endl;
+        return false;
+    }
+
+    // Ended tracks free their record for the next new id
+    if (fields.removed) {
+        tracks->remove(fields.id, fields.idLength);
+        return true;
     }
+
+    if (fields.id && fields.hasPosition) {
+        TrackSample sample;
+        sample.timeUs = ingestClock.nsecsElapsed() / 1000;
+        sample.lat = fields.lat;
+        sample.lon = fields.lon;
+        sample.altitude = fields.altitude;
+        sample.speed = fields.speed;
+        sample.heading = fields.heading;
+        tracks->ingest(fields.id, fields.idLength, sample);
+        ++ingestedSinceReport;
+
+        if (logging) {
+            std::cout << "Received entity/emitter update for ID: "
+                     << std::string(fields.id, fields.idLength) << std::endl;
+        }
+    }
+    return true;
+}
+
+QJsonObject NetworkedEWAM::trackJson(const TrackRecord& record, bool withHistory) const {
+    qint64 nowUs = ingestClock.nsecsElapsed() / 1000;
+
+    QJsonObject json;
+    json["id"] = QString::fromUtf8(record.id, record.idLength);
+    json["lat"] = record.latest.lat;
+    json["lon"] = record.latest.lon;
+    json["altitude"] = record.latest.altitude;
+    json["speed"] = record.latest.speed;
+    json["heading"] = record.latest.heading;
+    json["ageMs"] = (nowUs - record.latest.timeUs) / 1000.0;
+    json["updates"] = static_cast<double>(record.updates);
+    json["rateHz"] = tracks->updateRate(record);
+
+    if (withHistory) {
+        QJsonArray history;
+        for (const TrackSample& sample : tracks->history(record)) {
+            QJsonObject point;
+            point["lat"] = sample.lat;
+            point["lon"] = sample.lon;
+            point["altitude"] = sample.altitude;
+            point["ageMs"] = (nowUs - sample.timeUs) / 1000.0;
+            history.append(point);
+        }
+        json["history"] = history;
+    }
+    return json;
+}
+
+QJsonObject NetworkedEWAM::answerQuery(const QJsonObject& query) const {
+    QString kind = query["query"].toString();
+    QJsonObject reply;
+    reply["query"] = kind;
+
+    if (kind == "track" || kind == "rate") {
+        QByteArray id = query["id"].toString().toUtf8();
+        const TrackRecord* record = tracks->find(id.constData(), id.size());
+        reply["id"] = query["id"];
+        reply["found"] = record != nullptr;
+        if (record && kind == "track") {
+            reply["track"] = trackJson(*record, true);
+        } else if (record) {
+            reply["rateHz"] = tracks->updateRate(*record);
+        }
+    }
+    else if (kind == "bbox") {
+        QJsonArray matches;
+        for (const TrackRecord* record : tracks->tracksInBox(query["latMin"].toDouble(), query["latMax"].toDouble(),
+                                                             query["lonMin"].toDouble(), query["lonMax"].toDouble())) {
+            matches.append(trackJson(*record, false));
+        }
+        reply["tracks"] = matches;
+    }
+    else if (kind == "stale") {
+        qint64 maxAgeUs = static_cast<qint64>(query["maxAgeMs"].toDouble(5000) * 1000);
+        QJsonArray ids;
+        for (const TrackRecord* record : tracks->staleTracks(ingestClock.nsecsElapsed() / 1000, maxAgeUs)) {
+            ids.append(QString::fromUtf8(record->id, record->idLength));
+        }
+        reply["ids"] = ids;
+    }
+    else {
+        reply["error"] = "unknown query (track, rate, bbox, stale)";
+    }
+    return reply;
+}
+
+void NetworkedEWAM::reportIngestStats() {
+    std::cout << QString("Ingest: %1 msgs/s | %2/%3 tracks | %4 rejected | %5 oversized lines")
+                .arg(ingestedSinceReport / 5.0, 0, 'f', 0)
+                .arg(tracks->size())
+                .arg(tracks->capacity())
+                .arg(tracks->rejected())
+                .arg(oversizedLines)
+                .toStdString() << std::endl;
+    ingestedSinceReport = 0;
 }
 
 void NetworkedEWAM::sendTestMessage(const QString& message) {
@@ -5,8 +5,18 @@
 #include <QTcpSocket>
 #include <QTcpServer>
 #include <QMap>
+#include <QJsonObject>
+#include <QElapsedTimer>
+#include <atomic>
+#include <memory>
+#include <thread>
 #include "../AbstractNetworkInterface/pe.h"
 #include "../AbstractNetworkInterface/emitter.h"
+#include "kinematics.h"
+#include "slotMap.h"
+#include "spscRing.h"
+#include "trackStore.h"
+#include "updateScheduler.h"
 
 struct SimulatedEntity {
     QString id;
@@ -26,8 +36,58 @@ struct SimulatedEntity {
     double targetAlt;
     double targetSpeed;
     double targetHeading;
+
+    // Local-tangent integrator state; lat/lon are re-projected from it
+    LocalTangentFrame frame;
+
+    // Values last shown in the console table, for highlighting changes
+    double shownLat;
+    double shownLon;
+    double shownAlt;
+    double shownSpeed;
+    double shownHeading;
+};
+
+// How a sharded run divides the entity population between worker processes
+enum class ShardMode {
+    Region,     // Longitude bands across the theatre window
+    IdRange     // Stable hash of the entity id
+};
+
+struct ShardAssignment {
+    int index = 0;
+    int count = 1;
+    ShardMode mode = ShardMode::Region;
+};
+
+// Simulation output handed from the simulate stage to the serialize stage
+struct OutboundRecord {
+    enum Kind { Entity, EntityRemoved, EmitterState, Control };
+
+    Kind kind = Entity;
+    quint64 sequence = 0;       // Emission order across the frame and control queues
+    SimulatedEntity entity;
+    Emitter emitter;
+    QJsonObject control;
+};
+
+// Snapshot of the pipeline stages; maxima cover the time since the last snapshot
+struct PipelineStats {
+    size_t frameQueueDepth;
+    size_t frameQueueCapacity;
+    size_t controlQueueDepth;
+    size_t controlQueueCapacity;
+    size_t wireQueueDepth;
+    size_t wireQueueCapacity;
+    quint64 droppedFrames;      // Serialize stage was too far behind
+    quint64 droppedWrites;      // No connection when transmitting
+    quint64 heldTicks;          // Control queue full, so the tick sent nothing
+    double maxTickLatenessMs;
+    double maxTickDurationMs;
 };
 
+class TrackFileWriter;
+
 class NetworkedEWAM : public QObject {
     Q_OBJECT
 
@@ -43,10 +103,39 @@ public:
     void setReconnectInterval(int msecs) { reconnectInterval = msecs; }
     bool isConnected() const { return socket->state() == QAbstractSocket::ConnectedState; }
 
+    // Simulation options
+    void setRandomSeed(uint seed);
+    void setEntityCount(int count) { entityCount = count; }
+    void setLogging(bool enabled) { logging = enabled; }
+    void setIntegrator(Integrator mode, double toleranceKm);
+    void setAdaptiveRates(bool enabled, double budgetPerSecond);
+    void setChurnRate(double perSecond);
+
+    // Runtime lifecycle; handles go stale once their entity is despawned
+    EntityHandle spawnEntity(const QString& id, const QString& type,
+                             double lat, double lon, double altitude);
+    bool despawnEntity(EntityHandle handle);
+
+    // Pipeline mode: simulate and serialize on their own threads, transmit on this one
+    void startPipeline(int intervalMs, int queueDepth);
+    void stopPipeline();
+    bool isPipelined() const { return pipelineActive; }
+    PipelineStats pipelineStats();
+
+    // Offline mode: run as fast as possible into a track file, no socket involved
+    bool runOffline(const QString& path, double durationS, int stepMs, qint64 startMs);
+
+    // Shard worker methods
+    void setShardAssignment(const ShardAssignment& assignment) { shard = assignment; }
+    bool isSharded() const { return shard.count > 1; }
+    static int shardFor(const QString& id, double lon, const ShardAssignment& assignment);
+
     // Server mode methods
     bool startServer(quint16 port);
     void stopServer();
     bool isServerMode() const { return server != nullptr; }
+    void configureTrackStore(int capacity, int historyLength);
+    const TrackStore* trackStore() const { return tracks.get(); }
 
     // Echo mode (for testing)
     void sendTestMessage(const QString& message);
@@ -59,19 +148,46 @@ private slots:
     void onDisconnected();
     void onError(QAbstractSocket::SocketError error);
     void tryReconnect();
+    void onSocketReadyRead();
+    void drainWireQueue();
+    void offerAdoptions();
+    void reportPipelineStats();
+    void reportIngestStats();
+    void reportRateStats();
+    void reportChurnStats();
 
 private:
-    void createSimulatedEntity(const QString& id, const QString& type,
-                             double lat, double lon, double altitude);
+    EntityHandle createSimulatedEntity(const QString& id, const QString& type,
+                                       double lat, double lon, double altitude);
+    EntityHandle insertEntity(const SimulatedEntity& entity);
+    void applyChurn(int deltaMs);
     void createSimulatedEmitter(const QString& id, const QString& type,
                                const QString& category, double lat, double lon);
     void updatePosition(SimulatedEntity& entity, double distanceKm);
+    void syncPosition(SimulatedEntity& entity);
     void updateDynamics(SimulatedEntity& entity, int deltaMs);
     void setNewTargets(SimulatedEntity& entity);
+    void emitEntity(SimulatedEntity& entity);
+    void emitDueEntities(int deltaMs);
+    int updateIntervalMs(const SimulatedEntity& entity) const;
     bool sendJson(const QJsonObject& json);
+    bool queueJson(const QJsonObject& json, bool closesTick = false);
     void sendEntityUpdate(const SimulatedEntity& entity);
+    bool sendEntityRemoval(const SimulatedEntity& entity);
     void sendEmitterUpdate(const Emitter& emitter);
-    void handleReceivedData(const QByteArray& data);
+    bool handleReceivedData(QTcpSocket* client, const char* data, int length);
+    QJsonObject answerQuery(const QJsonObject& query) const;
+    QJsonObject trackJson(const TrackRecord& record, bool withHistory) const;
+    QJsonObject shardControl(const QString& kind, QJsonObject json) const;
+    bool handOffEntity(const SimulatedEntity& entity, int toShard);
+    void adoptEntity(const QJsonObject& json);
+    bool ownsPosition(const QString& id, double lon) const;
+    OutboundRecord* claimRecord();
+    OutboundRecord* claimControlRecord(bool closesTick);
+    void drainAdoptions();
+    void simulateLoop(int intervalMs);
+    void serializeLoop();
+    void scheduleDrain();
 
     QTcpSocket* socket;
     QString currentHost;
@@ -83,9 +199,64 @@ private:
     bool autoReconnect;
     QTcpServer* server;          // For server mode
     QList<QTcpSocket*> clients;  // Connected clients in server mode
-    QMap<QString, SimulatedEntity> entities;
+    SlotMap<SimulatedEntity> entities;
     QMap<QString, Emitter> emitters;
-    QByteArray buffer;           // For accumulating incoming data
+    QByteArray buffer;           // Server mode: one line at a time, reused across reads
+    std::unique_ptr<TrackStore> tracks;  // Latest state and history of ingested ids
+    QElapsedTimer ingestClock;
+    QTimer* ingestStatsTimer;
+    quint64 ingestedSinceReport;
+    quint64 oversizedLines;
+    const int MAX_LINE_LENGTH = 64 * 1024;
+    ShardAssignment shard;       // Single shard unless launched as a worker
+    quint64 tickCount;
+    uint randomSeed;
+    int entityCount;             // Population of the theatre scenario
+    bool logging;
+    qint64 simTimeMs;            // Simulation clock; wall-clock start unless run offline
+    TrackFileWriter* trackWriter;  // Set while running offline
+    bool adaptiveRates;
+    UpdateScheduler scheduler;
+    QTimer* rateStatsTimer;
+    Integrator integrator;
+    double reanchorToleranceKm;  // Local-tangent drift before re-anchoring
+
+    // Steady spawn/despawn load for soak runs
+    double churnPerSecond;
+    double churnCarry;           // Fractional spawns owed from earlier ticks
+    quint64 churnSerial;
+    QTimer* churnStatsTimer;
+    std::atomic<quint64> spawnedCount;
+    std::atomic<quint64> despawnedCount;
+    std::atomic<quint64> churnTicks;
+    std::atomic<qint64> churnTickTotalUs;
+    std::atomic<qint64> churnTickMaxUs;
+    std::atomic<int> liveEntities;           // Store occupancy as of the last tick
+    std::atomic<int> entitySlots;
+    std::atomic<int> freeEntitySlots;
+
+    // Pipeline stages and the queues between them
+    bool pipelineActive;
+    std::atomic<bool> pipelineRunning;
+    std::atomic<bool> linkUp;            // Socket state as seen from the simulate thread
+    std::atomic<bool> drainScheduled;
+    std::unique_ptr<SpscRing<OutboundRecord>> frameQueue;  // simulate -> serialize
+    std::unique_ptr<SpscRing<OutboundRecord>> controlQueue;  // never shed: ticks, handoffs, removals
+    quint64 outboundSequence;            // Simulate thread only
+    bool tickOutputOpen;                 // Whether this tick may queue output at all
+    std::unique_ptr<SpscRing<QByteArray>> wireQueue;       // serialize -> transmit
+    std::unique_ptr<SpscRing<QJsonObject>> adoptQueue;     // shard handoffs -> simulate
+    QList<QJsonObject> pendingAdoptions; // Handoffs the adopt queue had no room for yet
+    QTimer* adoptRetryTimer;
+    std::thread simulateThread;
+    std::thread serializeThread;
+    QTimer* pipelineStatsTimer;
+    std::atomic<quint64> droppedFrames;
+    std::atomic<quint64> droppedWrites;
+    std::atomic<quint64> heldTicks;
+    std::atomic<qint64> maxTickLatenessUs;
+    std::atomic<qint64> maxTickDurationUs;
+    const qint64 MAX_SOCKET_BACKLOG = 4 * 1024 * 1024;
 };
 
 #endif // NETWORKEDEWAM_H
@@ -0,0 +1,411 @@
+#include "shardCoordinator.h"
+#include <QCoreApplication>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QTimer>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+ShardCoordinator::ShardCoordinator(QObject *parent)
+    : QObject(parent)
+    , aggregator(new QTcpServer(this))
+    , upstream(new QTcpSocket(this))
+    , statsTimer(new QTimer(this))
+    , lastFlushedTick(0)
+    , mergedSinceReport(0)
+    , handoffsSinceReport(0)
+    , droppedSinceReport(0)
+    , shedTicksSinceReport(0)
+{
+    connect(aggregator, &QTcpServer::newConnection, this, &ShardCoordinator::onWorkerConnection);
+    connect(upstream, &QTcpSocket::connected, []() {
+        std::cout << "Aggregator connected to upstream listener" << std::endl;
+    });
+    connect(upstream, &QTcpSocket::disconnected, this, &ShardCoordinator::onUpstreamDisconnected);
+
+    // The listener may echo the feed back; nothing from it is used
+    connect(upstream, &QTcpSocket::readyRead, [this]() {
+        upstream->readAll();
+    });
+    connect(upstream, QOverload<QAbstractSocket::SocketError>::of(&QTcpSocket::error),
+            this, &ShardCoordinator::onUpstreamError);
+    connect(statsTimer, &QTimer::timeout, this, &ShardCoordinator::reportThroughput);
+}
+
+ShardCoordinator::~ShardCoordinator() {
+    stop();
+}
+
+bool ShardCoordinator::start(const ShardLaunchConfig& launchConfig) {
+    config = launchConfig;
+    socketByShard.fill(nullptr, config.shardCount);
+    joined.fill(false, config.shardCount);
+    exited.fill(false, config.shardCount);
+    streams.resize(config.shardCount);
+
+    // Workers only ever talk to the aggregator over loopback
+    if (!aggregator->listen(QHostAddress::LocalHost, 0)) {
+        std::cerr << "Failed to start shard aggregator: "
+                  << aggregator->errorString().toStdString() << std::endl;
+        return false;
+    }
+
+    std::cout << "Shard aggregator listening on 127.0.0.1:" << aggregator->serverPort() << std::endl;
+    std::cout << "Connecting aggregator to " << config.upstreamHost.toStdString()
+              << ":" << config.upstreamPort << "..." << std::endl;
+    upstream->connectToHost(config.upstreamHost, config.upstreamPort);
+
+    for (int i = 0; i < config.shardCount; ++i) {
+        launchWorker(i, aggregator->serverPort());
+    }
+
+    statsTimer->start(1000);
+    return true;
+}
+
+void ShardCoordinator::stop() {
+    statsTimer->stop();
+
+    for (QProcess* worker : workers) {
+        if (worker->state() != QProcess::NotRunning) {
+            worker->terminate();
+            if (!worker->waitForFinished(2000)) {
+                worker->kill();
+                worker->waitForFinished(1000);
+            }
+        }
+    }
+    qDeleteAll(workers);
+    workers.clear();
+
+    aggregator->close();
+}
+
+void ShardCoordinator::launchWorker(int index, quint16 aggregatorPort) {
+    QStringList args;
+    args << "-s" << config.scenario
+         << "-i" << QString::number(config.interval)
+         << "-H" << "127.0.0.1"
+         << "-p" << QString::number(aggregatorPort)
+         << "--shards" << QString::number(config.shardCount)
+         << "--shard-index" << QString::number(index)
+         << "--shard-mode" << (config.mode == ShardMode::IdRange ? "id" : "region")
+         << "--seed" << QString::number(config.seed)
+         << "--entities" << QString::number(config.entityCount)
+         << config.workerOptions;
+
+    // Workers keep their errors on our stderr but their tick tables to themselves
+    QProcess* worker = new QProcess(this);
+    worker->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    worker->setStandardOutputFile(QProcess::nullDevice());
+    connect(worker, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, [this, index](int exitCode, QProcess::ExitStatus) {
+        std::cout << "Shard " << index << " exited with code " << exitCode << std::endl;
+
+        // A worker that died before saying hello must not hold the feed back
+        exited[index] = true;
+        flushReadyTicks();
+    });
+
+    worker->start(QCoreApplication::applicationFilePath(), args);
+    workers.append(worker);
+    std::cout << "Launched shard " << index << " of " << config.shardCount << std::endl;
+}
+
+void ShardCoordinator::onWorkerConnection() {
+    while (QTcpSocket* worker = aggregator->nextPendingConnection()) {
+        connect(worker, &QTcpSocket::readyRead, this, &ShardCoordinator::onWorkerReadyRead);
+        connect(worker, &QTcpSocket::disconnected, this, &ShardCoordinator::onWorkerDisconnected);
+    }
+}
+
+void ShardCoordinator::onWorkerReadyRead() {
+    QTcpSocket* worker = qobject_cast<QTcpSocket*>(sender());
+    if (!worker) return;
+
+    // Until a worker says hello its lines are read one at a time
+    while (!shardBySocket.contains(worker) && worker->canReadLine()) {
+        QByteArray line = worker->readLine();
+        if (line.contains("\"ctl\":")) {
+            handleControl(worker, line.constData(), line.size());
+        } else {
+            ++droppedSinceReport;
+        }
+    }
+
+    auto it = shardBySocket.constFind(worker);
+    if (it == shardBySocket.constEnd()) {
+        return;
+    }
+
+    // After that, everything available is taken in one read and split in place
+    streams[it.value()].data += worker->readAll();
+    scanLines(worker, it.value());
+}
+
+static int findBytes(const char* data, int length, const char* pattern, int patternLength) {
+    for (int i = 0; i + patternLength <= length; ++i) {
+        if (data[i] == pattern[0] && memcmp(data + i, pattern, patternLength) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void ShardCoordinator::scanLines(QTcpSocket* worker, int shard) {
+    ShardStream& stream = streams[shard];
+    for (;;) {
+        int newline = stream.data.indexOf('\n', stream.scanned);
+        if (newline < 0) {
+            break;
+        }
+
+        int start = stream.scanned;
+        int length = newline + 1 - start;
+        stream.scanned = newline + 1;
+        const char* line = stream.data.constData() + start;
+
+        // Control messages are rare, so only those pay for a full JSON parse.
+        // A tick marker moves the stream's lines into a pending tick.
+        if (findBytes(line, length, "\"ctl\":", 6) >= 0) {
+            handleControl(worker, line, length);
+            continue;
+        }
+
+        LineRef ref;
+        ref.offset = start;
+        ref.length = length;
+        ref.idOffset = start;
+        ref.idLength = 0;
+        int id = findBytes(line, length, "\"id\":\"", 6);
+        if (id >= 0) {
+            ref.idOffset = start + id + 6;
+            const char* end = static_cast<const char*>(
+                memchr(stream.data.constData() + ref.idOffset, '"', newline - ref.idOffset));
+            ref.idLength = end ? static_cast<int>(end - stream.data.constData()) - ref.idOffset : 0;
+        }
+        stream.lines.append(ref);
+    }
+}
+
+void ShardCoordinator::onWorkerDisconnected() {
+    QTcpSocket* worker = qobject_cast<QTcpSocket*>(sender());
+    if (!worker) return;
+
+    auto it = shardBySocket.find(worker);
+    if (it != shardBySocket.end()) {
+        std::cout << "Shard " << it.value() << " disconnected from aggregator" << std::endl;
+        socketByShard[it.value()] = nullptr;
+        streams[it.value()] = ShardStream();
+        shardBySocket.erase(it);
+    }
+    worker->deleteLater();
+
+    // The remaining shards should not wait on a tick that will never close
+    flushReadyTicks();
+}
+
+void ShardCoordinator::onUpstreamDisconnected() {
+    std::cout << "Aggregator lost upstream listener" << std::endl;
+    QTimer::singleShot(UPSTREAM_RETRY_MS, upstream, [this]() {
+        upstream->connectToHost(config.upstreamHost, config.upstreamPort);
+    });
+}
+
+void ShardCoordinator::onUpstreamError(QAbstractSocket::SocketError error) {
+    std::cerr << "Upstream socket error: " << upstream->errorString().toStdString() << std::endl;
+
+    if (error == QAbstractSocket::ConnectionRefusedError) {
+        QTimer::singleShot(UPSTREAM_RETRY_MS, upstream, [this]() {
+            upstream->connectToHost(config.upstreamHost, config.upstreamPort);
+        });
+    }
+}
+
+void ShardCoordinator::handleControl(QTcpSocket* worker, const char* line, int length) {
+    QJsonDocument doc = QJsonDocument::fromJson(QByteArray(line, length));
+    if (doc.isNull() || !doc.isObject()) {
+        return;
+    }
+
+    QJsonObject json = doc.object();
+    QString kind = json["ctl"].toString();
+    int shard = json["shard"].toInt(-1);
+    if (shard < 0 || shard >= config.shardCount) {
+        std::cerr << "Ignoring control message from unknown shard " << shard << std::endl;
+        return;
+    }
+
+    if (kind == "hello") {
+        joined[shard] = true;
+        socketByShard[shard] = worker;
+        shardBySocket[worker] = shard;
+        std::cout << "Shard " << shard << " joined aggregator" << std::endl;
+    }
+    else if (kind == "tick") {
+        // Only a joined worker's own stream can be cut at its marker
+        if (shardBySocket.value(worker, -1) == shard) {
+            closeTick(shard, static_cast<quint64>(json["tick"].toDouble()));
+            flushReadyTicks();
+        }
+    }
+    else if (kind == "handoff") {
+        int target = json["toShard"].toInt(-1);
+        QTcpSocket* targetSocket = (target >= 0 && target < config.shardCount) ? socketByShard[target] : nullptr;
+        if (targetSocket) {
+            targetSocket->write(line, length);
+            ++handoffsSinceReport;
+        } else {
+            std::cerr << "Lost " << json["id"].toString().toStdString()
+                      << ": shard " << target << " is not connected" << std::endl;
+        }
+    }
+}
+
+void ShardCoordinator::closeTick(int shard, quint64 tick) {
+    // Ticks already merged without this shard absorb its late lines
+    PendingTick& pending = pendingTicks[qMax(tick, lastFlushedTick + 1)];
+    if (pending.reported.isEmpty()) {
+        pending.reported.fill(false, config.shardCount);
+        pending.parts.resize(config.shardCount);
+    }
+    if (!pending.reported[shard]) {
+        pending.reported[shard] = true;
+        ++pending.reportedCount;
+    }
+
+    // Everything up to and including the marker belongs to this tick
+    ShardStream& stream = streams[shard];
+    ShardLines& part = pending.parts[shard];
+    int cut = stream.scanned;
+    if (part.data.isEmpty()) {
+        part.data.swap(stream.data);
+        part.lines.swap(stream.lines);
+        stream.data = part.data.mid(cut);
+        part.data.truncate(cut);
+    } else {
+        int shift = part.data.size();
+        part.data.append(stream.data.constData(), cut);
+        for (LineRef ref : stream.lines) {
+            ref.offset += shift;
+            ref.idOffset += shift;
+            part.lines.append(ref);
+        }
+        stream.data.remove(0, cut);
+        stream.lines.clear();
+    }
+    stream.scanned = 0;
+}
+
+bool ShardCoordinator::tickComplete(const PendingTick& pending) const {
+    // Hold the feed until every worker has started streaming or exited
+    for (int i = 0; i < config.shardCount; ++i) {
+        if (exited[i]) {
+            continue;
+        }
+        if (!joined[i] || (socketByShard[i] && !pending.reported[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ShardCoordinator::flushReadyTicks() {
+    // A stalled shard must not hold back the whole feed indefinitely
+    while (!pendingTicks.isEmpty()) {
+        auto first = pendingTicks.begin();
+        if (!tickComplete(first.value()) && pendingTicks.size() <= MAX_PENDING_TICKS) {
+            break;
+        }
+
+        flushTick(first.value());
+        lastFlushedTick = first.key();
+        pendingTicks.erase(first);
+    }
+}
+
+// Orders lines by id bytes, as a plain byte-string comparison would
+static bool idLess(const char* a, int aLength, const char* b, int bLength) {
+    int order = memcmp(a, b, qMin(aLength, bLength));
+    return order != 0 ? order < 0 : aLength < bLength;
+}
+
+void ShardCoordinator::flushTick(PendingTick& pending) {
+    int lineCount = 0;
+    int totalSize = 0;
+    for (const ShardLines& part : pending.parts) {
+        lineCount += part.lines.size();
+        totalSize += part.data.size();
+    }
+
+    // Shed whole ticks rather than buffer without bound behind a slow listener
+    if (upstream->bytesToWrite() > MAX_UPSTREAM_BACKLOG) {
+        droppedSinceReport += lineCount;
+        ++shedTicksSinceReport;
+        return;
+    }
+
+    // Sort each shard's lines on their own, then k-way merge them by id
+    for (ShardLines& part : pending.parts) {
+        const char* data = part.data.constData();
+        std::sort(part.lines.begin(), part.lines.end(), [data](const LineRef& a, const LineRef& b) {
+            return idLess(data + a.idOffset, a.idLength, data + b.idOffset, b.idLength);
+        });
+    }
+
+    feed.resize(0);
+    feed.reserve(totalSize);
+    QVector<int> next(pending.parts.size(), 0);
+    for (;;) {
+        int best = -1;
+        for (int shard = 0; shard < pending.parts.size(); ++shard) {
+            const ShardLines& part = pending.parts[shard];
+            if (next[shard] >= part.lines.size()) {
+                continue;
+            }
+            if (best >= 0) {
+                const LineRef& a = part.lines[next[shard]];
+                const LineRef& b = pending.parts[best].lines[next[best]];
+                if (!idLess(part.data.constData() + a.idOffset, a.idLength,
+                            pending.parts[best].data.constData() + b.idOffset, b.idLength)) {
+                    continue;
+                }
+            }
+            best = shard;
+        }
+        if (best < 0) {
+            break;
+        }
+
+        const ShardLines& part = pending.parts[best];
+        const LineRef& line = part.lines[next[best]++];
+        feed.append(part.data.constData() + line.offset, line.length);
+    }
+
+    if (upstream->state() != QAbstractSocket::ConnectedState || upstream->write(feed) == -1) {
+        droppedSinceReport += lineCount;
+        return;
+    }
+    mergedSinceReport += lineCount;
+}
+
+void ShardCoordinator::reportThroughput() {
+    int liveShards = shardBySocket.size();
+    std::cout << QString("Shards %1/%2 | merged %3 upd/s | handoffs %4/s | dropped %5/s (%6 ticks shed)"
+                         " | tick %7 (%8 pending)")
+                .arg(liveShards)
+                .arg(config.shardCount)
+                .arg(mergedSinceReport)
+                .arg(handoffsSinceReport)
+                .arg(droppedSinceReport)
+                .arg(shedTicksSinceReport)
+                .arg(lastFlushedTick)
+                .arg(pendingTicks.size())
+                .toStdString() << std::endl;
+
+    mergedSinceReport = 0;
+    handoffsSinceReport = 0;
+    droppedSinceReport = 0;
+    shedTicksSinceReport = 0;
+}
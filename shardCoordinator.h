@@ -0,0 +1,104 @@
+#ifndef SHARDCOORDINATOR_H
+#define SHARDCOORDINATOR_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTcpServer>
+#include <QProcess>
+#include <QMap>
+#include <QVector>
+#include "networkedEWAM.h"
+
+class QTimer;
+
+struct ShardLaunchConfig {
+    int shardCount;
+    ShardMode mode;
+    QString scenario;
+    int interval;
+    int entityCount;
+    uint seed;
+    QString upstreamHost;
+    quint16 upstreamPort;
+    QStringList workerOptions;   // Simulation options passed through unchanged
+};
+
+// Runs N local NetworkedEWAM worker processes and merges their streams into
+// a single feed, ordered by id within each tick, towards the real listener.
+class ShardCoordinator : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ShardCoordinator(QObject *parent = nullptr);
+    ~ShardCoordinator();
+
+    bool start(const ShardLaunchConfig& launchConfig);
+    void stop();
+
+private slots:
+    void onWorkerConnection();
+    void onWorkerReadyRead();
+    void onWorkerDisconnected();
+    void onUpstreamDisconnected();
+    void onUpstreamError(QAbstractSocket::SocketError error);
+    void reportThroughput();
+
+private:
+    // One data line, as offsets into the buffer it arrived in
+    struct LineRef {
+        int offset;
+        int length;
+        int idOffset;
+        int idLength;
+    };
+
+    // A shard's bytes and the data lines found in them. Lines are never
+    // copied out of the buffer until the merged feed is built.
+    struct ShardLines {
+        QByteArray data;
+        QVector<LineRef> lines;
+    };
+
+    // Bytes received from a shard whose tick has not closed yet
+    struct ShardStream : ShardLines {
+        int scanned = 0;            // Bytes already split into lines
+    };
+
+    // Lines of one tick, collected from every live shard before merging
+    struct PendingTick {
+        QVector<bool> reported;
+        int reportedCount = 0;
+        QVector<ShardLines> parts;  // Per shard
+    };
+
+    void launchWorker(int index, quint16 aggregatorPort);
+    void scanLines(QTcpSocket* worker, int shard);
+    void handleControl(QTcpSocket* worker, const char* line, int length);
+    void closeTick(int shard, quint64 tick);
+    bool tickComplete(const PendingTick& pending) const;
+    void flushReadyTicks();
+    void flushTick(PendingTick& pending);
+
+    ShardLaunchConfig config;
+    QTcpServer* aggregator;
+    QTcpSocket* upstream;
+    QTimer* statsTimer;
+    QList<QProcess*> workers;
+    QMap<QTcpSocket*, int> shardBySocket;
+    QVector<QTcpSocket*> socketByShard;
+    QVector<bool> joined;
+    QVector<bool> exited;                // Worker process has finished
+    QVector<ShardStream> streams;        // Each shard's open tick
+    QByteArray feed;                     // Merged tick, reused between ticks
+    QMap<quint64, PendingTick> pendingTicks;
+    quint64 lastFlushedTick;
+    quint64 mergedSinceReport;
+    quint64 handoffsSinceReport;
+    quint64 droppedSinceReport;
+    quint64 shedTicksSinceReport;
+    const int MAX_PENDING_TICKS = 8;
+    const qint64 MAX_UPSTREAM_BACKLOG = 4 * 1024 * 1024;
+    const int UPSTREAM_RETRY_MS = 5000;
+};
+
+#endif // SHARDCOORDINATOR_H
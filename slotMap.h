@@ -0,0 +1,101 @@
+#ifndef SLOTMAP_H
+#define SLOTMAP_H
+
+#include <QtGlobal>
+#include <vector>
+
+// Reference to a slot map entry. The generation changes every time the slot
+// is freed, so a handle kept past its entry's removal no longer resolves,
+// even after the slot has been reused.
+struct EntityHandle {
+    quint32 index = 0;
+    quint32 generation = 0;     // Live generations are odd, so 0 is never valid
+
+    bool operator==(const EntityHandle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+};
+
+// Dense slot storage with free-list reuse. Slots are never released, so a
+// steady insert/remove churn settles on a fixed slot count instead of
+// allocating per entry; removing during iteration by index is safe.
+template <typename T>
+class SlotMap {
+public:
+    void reserve(int count) {
+        slots.reserve(count);
+        freeSlots.reserve(count);
+    }
+
+    EntityHandle insert(const T& value) {
+        quint32 index;
+        if (!freeSlots.empty()) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            index = static_cast<quint32>(slots.size());
+            slots.push_back(Slot());
+        }
+
+        Slot& slot = slots[index];
+        slot.value = value;
+        ++slot.generation;
+        ++liveCount;
+
+        EntityHandle handle;
+        handle.index = index;
+        handle.generation = slot.generation;
+        return handle;
+    }
+
+    // Returns false when the handle is already stale
+    bool remove(EntityHandle handle) {
+        if (!contains(handle)) {
+            return false;
+        }
+
+        Slot& slot = slots[handle.index];
+        ++slot.generation;
+        slot.value = T();   // Drop anything the value holds on to
+        freeSlots.push_back(handle.index);
+        --liveCount;
+        return true;
+    }
+
+    bool contains(EntityHandle handle) const {
+        return handle.index < slots.size() && slots[handle.index].generation == handle.generation &&
+               (handle.generation & 1);
+    }
+
+    T* get(EntityHandle handle) {
+        return contains(handle) ? &slots[handle.index].value : nullptr;
+    }
+
+    // Iteration by slot index; skip indices where isLive() is false
+    int slotCount() const { return static_cast<int>(slots.size()); }
+    bool isLive(int index) const { return slots[index].generation & 1; }
+    T& at(int index) { return slots[index].value; }
+
+    EntityHandle handleAt(int index) const {
+        EntityHandle handle;
+        handle.index = index;
+        handle.generation = slots[index].generation;
+        return handle;
+    }
+
+    int size() const { return liveCount; }
+    int freeCount() const { return static_cast<int>(freeSlots.size()); }
+
+private:
+    struct Slot {
+        T value;
+        quint32 generation = 0;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<quint32> freeSlots;
+    int liveCount = 0;
+};
+
+#endif // SLOTMAP_H
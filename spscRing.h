@@ -0,0 +1,80 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free single-producer/single-consumer ring. Slots are
+// preallocated and filled/read in place, so nothing is copied through the
+// queue itself: the producer claims a slot, writes it and publishes it; the
+// consumer reads the front slot and pops it when done.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t minCapacity)
+        : mask(roundUpPowerOfTwo(minCapacity) - 1)
+        , slots(mask + 1)
+        , head(0)
+        , tail(0)
+    {
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side: returns nullptr when the ring is full, or when fewer
+    // than `reserve` slots would be left free after this one
+    T* claim(size_t reserve = 0) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) + reserve > mask) {
+            return nullptr;
+        }
+        return &slots[t & mask];
+    }
+
+    void publish() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer side: returns nullptr when the ring is empty
+    T* front() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots[h & mask];
+    }
+
+    void pop() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Safe to call from any thread; exact only when both sides are idle.
+    // Head is read first so a pop in between cannot make tail - head wrap.
+    size_t size() const {
+        size_t h = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - h;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    static size_t roundUpPowerOfTwo(size_t value) {
+        size_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    const size_t mask;
+    std::vector<T> slots;
+
+    // Padding keeps the producer and consumer indices on separate cache lines
+    std::atomic<size_t> head;
+    char headPadding[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail;
+};
+
+#endif // SPSCRING_H
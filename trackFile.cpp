@@ -0,0 +1,282 @@
+#include "trackFile.h"
+#include <QtGlobal>
+#include <algorithm>
+#include <iostream>
+
+// Columns are dumped straight from memory
+Q_STATIC_ASSERT_X(Q_BYTE_ORDER == Q_LITTLE_ENDIAN, "track files are written in host byte order");
+
+static const char FILE_MAGIC[8] = {'E', 'W', 'T', 'R', 'K', '\0', '\0', '\1'};
+static const char TRAILER_MAGIC[8] = {'E', 'W', 'T', 'R', 'K', 'E', 'N', 'D'};
+static const quint32 FILE_VERSION = 2;
+static const quint32 CHUNK_MAGIC = 0x4b4e4843;  // "CHNK"
+
+template <typename T>
+static void resetColumn(std::vector<T>& column, int reserve) {
+    column.clear();
+    column.reserve(reserve);
+}
+
+TrackFileWriter::TrackFileWriter(int chunkRows)
+    : chunkRows(chunkRows)
+    , totalRows(0)
+    , entityRowCount(0)
+    , nextCode(0)
+{
+}
+
+TrackFileWriter::~TrackFileWriter() {
+    if (file.isOpen()) {
+        close();
+    }
+}
+
+bool TrackFileWriter::open(const QString& path) {
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::cerr << "Failed to open track file " << path.toStdString() << ": "
+                  << file.errorString().toStdString() << std::endl;
+        return false;
+    }
+
+    file.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+    writeValue<quint32>(FILE_VERSION);
+    writeValue<quint32>(chunkRows);
+
+    totalRows = 0;
+    entityRowCount = 0;
+    dictionary.clear();
+    nextCode = 0;
+    newStrings.clear();
+    chunks.clear();
+    flushEntities();
+    flushEmitters();
+    return true;
+}
+
+bool TrackFileWriter::close() {
+    if (!file.isOpen()) {
+        return false;
+    }
+
+    flushEntities();
+    flushEmitters();
+
+    quint64 footerOffset = file.pos();
+
+    writeValue<quint32>(chunks.size());
+    for (const ChunkInfo& chunk : chunks) {
+        writeValue<quint64>(chunk.offset);
+        writeValue<quint64>(chunk.bytes);
+        writeValue<quint8>(chunk.table);
+        writeValue<quint32>(chunk.rows);
+        writeValue<qint64>(chunk.firstTimeMs);
+        writeValue<qint64>(chunk.lastTimeMs);
+        writeValue<quint64>(chunk.idsOffset);
+        writeValue<quint32>(chunk.idCount);
+    }
+
+    writeValue<quint64>(footerOffset);
+    file.write(TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+
+    bool ok = file.error() == QFileDevice::NoError;
+    if (!ok) {
+        std::cerr << "Failed to write track file: " << file.errorString().toStdString() << std::endl;
+    }
+    file.close();
+    return ok;
+}
+
+quint32 TrackFileWriter::stringCode(const QString& value) {
+    auto it = dictionary.constFind(value);
+    if (it != dictionary.constEnd()) {
+        return it.value();
+    }
+
+    quint32 code = nextCode++;
+    dictionary.insert(value, code);
+    newStrings.append(value);
+    return code;
+}
+
+void TrackFileWriter::appendEntity(qint64 timeMs, const SimulatedEntity& entity, EntityState state) {
+    EntityColumns& rows = entityRows;
+    rows.timeMs.push_back(timeMs);
+    rows.id.push_back(stringCode(entity.id));
+    rows.type.push_back(stringCode(entity.type));
+    rows.lat.push_back(entity.lat);
+    rows.lon.push_back(entity.lon);
+    rows.altitude.push_back(entity.altitude);
+    rows.speed.push_back(entity.speed);
+    rows.heading.push_back(entity.heading);
+    rows.category.push_back(static_cast<qint32>(entity.category));
+    rows.priority.push_back(stringCode(entity.priority));
+    rows.jam.push_back(entity.jam ? 1 : 0);
+    rows.state.push_back(state);
+
+    // Ids are never reused after removal, so forget them to keep the
+    // dictionary the size of the live population
+    if (state == Removed) {
+        dictionary.remove(entity.id);
+    }
+
+    ++totalRows;
+    ++entityRowCount;
+    if (static_cast<int>(rows.timeMs.size()) >= chunkRows) {
+        flushEntities();
+    }
+}
+
+void TrackFileWriter::appendEmitter(qint64 timeMs, const Emitter& emitter) {
+    EmitterColumns& rows = emitterRows;
+    rows.timeMs.push_back(timeMs);
+    rows.id.push_back(stringCode(emitter.id));
+    rows.type.push_back(stringCode(emitter.type));
+    rows.category.push_back(stringCode(emitter.category));
+    rows.lat.push_back(emitter.lat);
+    rows.lon.push_back(emitter.lon);
+    rows.freqMin.push_back(emitter.freqMin);
+    rows.freqMax.push_back(emitter.freqMax);
+    rows.active.push_back(emitter.active ? 1 : 0);
+    rows.jam.push_back(emitter.jam ? 1 : 0);
+
+    ++totalRows;
+    if (static_cast<int>(rows.timeMs.size()) >= chunkRows) {
+        flushEmitters();
+    }
+}
+
+void TrackFileWriter::beginChunk(Table table, const std::vector<qint64>& timeMs,
+                                 const std::vector<quint32>& ids) {
+    ChunkInfo chunk;
+    chunk.offset = file.pos();
+    chunk.bytes = 0;    // Patched by endChunk
+    chunk.table = table;
+    chunk.rows = timeMs.size();
+    chunk.firstTimeMs = timeMs.front();
+    chunk.lastTimeMs = timeMs.back();
+
+    writeValue<quint32>(CHUNK_MAGIC);
+    writeValue<quint8>(table);
+    file.write("\0\0\0", 3);
+    writeValue<quint32>(chunk.rows);
+    writeValue<quint64>(chunk.bytes);
+    writeValue<qint64>(chunk.firstTimeMs);
+    writeValue<qint64>(chunk.lastTimeMs);
+
+    // Strings first used since the previous chunk
+    writeValue<quint32>(nextCode - newStrings.size());
+    writeValue<quint32>(newStrings.size());
+    for (const QString& value : newStrings) {
+        QByteArray utf8 = value.toUtf8();
+        writeValue<quint32>(utf8.size());
+        file.write(utf8);
+    }
+    newStrings.clear();
+
+    // Rows are appended in time order, so ordering by (id, row) keeps each
+    // id's rows in time order
+    rowOrder.resize(chunk.rows);
+    for (quint32 row = 0; row < chunk.rows; ++row) {
+        rowOrder[row] = row;
+    }
+    std::sort(rowOrder.begin(), rowOrder.end(), [&ids](quint32 a, quint32 b) {
+        return ids[a] != ids[b] ? ids[a] < ids[b] : a < b;
+    });
+
+    chunk.idsOffset = file.pos();
+    chunk.idCount = 0;
+    writeValue<quint32>(0);     // Patched below
+    quint32 runStart = 0;
+    for (quint32 row = 1; row <= chunk.rows; ++row) {
+        if (row == chunk.rows || ids[rowOrder[row]] != ids[rowOrder[runStart]]) {
+            writeValue<quint32>(ids[rowOrder[runStart]]);
+            writeValue<quint32>(runStart);
+            writeValue<quint32>(row - runStart);
+            ++chunk.idCount;
+            runStart = row;
+        }
+    }
+
+    qint64 end = file.pos();
+    file.seek(chunk.idsOffset);
+    writeValue<quint32>(chunk.idCount);
+    file.seek(end);
+
+    chunks.append(chunk);
+}
+
+void TrackFileWriter::endChunk() {
+    ChunkInfo& chunk = chunks.last();
+    qint64 end = file.pos();
+    chunk.bytes = end - chunk.offset;
+
+    file.seek(chunk.offset + 12);   // Past magic, table, padding and rows
+    writeValue<quint64>(chunk.bytes);
+    file.seek(end);
+
+    // Leave only whole chunks behind if the run is killed
+    file.flush();
+}
+
+void TrackFileWriter::flushEntities() {
+    EntityColumns& rows = entityRows;
+    if (!rows.timeMs.empty()) {
+        beginChunk(EntityTable, rows.timeMs, rows.id);
+        writeColumn(rows.timeMs);
+        writeColumn(rows.id);
+        writeColumn(rows.type);
+        writeColumn(rows.lat);
+        writeColumn(rows.lon);
+        writeColumn(rows.altitude);
+        writeColumn(rows.speed);
+        writeColumn(rows.heading);
+        writeColumn(rows.category);
+        writeColumn(rows.priority);
+        writeColumn(rows.jam);
+        writeColumn(rows.state);
+        endChunk();
+    }
+
+    resetColumn(rows.timeMs, chunkRows);
+    resetColumn(rows.id, chunkRows);
+    resetColumn(rows.type, chunkRows);
+    resetColumn(rows.lat, chunkRows);
+    resetColumn(rows.lon, chunkRows);
+    resetColumn(rows.altitude, chunkRows);
+    resetColumn(rows.speed, chunkRows);
+    resetColumn(rows.heading, chunkRows);
+    resetColumn(rows.category, chunkRows);
+    resetColumn(rows.priority, chunkRows);
+    resetColumn(rows.jam, chunkRows);
+    resetColumn(rows.state, chunkRows);
+}
+
+void TrackFileWriter::flushEmitters() {
+    EmitterColumns& rows = emitterRows;
+    if (!rows.timeMs.empty()) {
+        beginChunk(EmitterTable, rows.timeMs, rows.id);
+        writeColumn(rows.timeMs);
+        writeColumn(rows.id);
+        writeColumn(rows.type);
+        writeColumn(rows.category);
+        writeColumn(rows.lat);
+        writeColumn(rows.lon);
+        writeColumn(rows.freqMin);
+        writeColumn(rows.freqMax);
+        writeColumn(rows.active);
+        writeColumn(rows.jam);
+        endChunk();
+    }
+
+    resetColumn(rows.timeMs, chunkRows);
+    resetColumn(rows.id, chunkRows);
+    resetColumn(rows.type, chunkRows);
+    resetColumn(rows.category, chunkRows);
+    resetColumn(rows.lat, chunkRows);
+    resetColumn(rows.lon, chunkRows);
+    resetColumn(rows.freqMin, chunkRows);
+    resetColumn(rows.freqMax, chunkRows);
+    resetColumn(rows.active, chunkRows);
+    resetColumn(rows.jam, chunkRows);
+}
@@ -0,0 +1,133 @@
+#ifndef TRACKFILE_H
+#define TRACKFILE_H
+
+#include <QFile>
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include <vector>
+#include "networkedEWAM.h"
+
+// Chunked columnar track file (.ewtrk), written as a stream so memory stays
+// bounded by one chunk per table plus the ids currently in use. All values
+// are little-endian.
+//
+//   header   "EWTRK\0\0\1" magic, uint32 version, uint32 chunk rows
+//   chunk    uint32 'CHNK', uint8 table, 3 pad bytes, uint32 rows,
+//            uint64 chunk bytes (from the magic on), int64 first/last time ms
+//            strings: uint32 first code, uint32 count, { uint32 length, UTF-8 bytes }
+//            ids:     uint32 count, { uint32 id code, uint32 first row, uint32 rows }
+//            then one contiguous array per column (see the append functions)
+//   footer   chunk index: uint32 count, { uint64 offset, uint64 bytes, uint8 table,
+//                                         uint32 rows, int64 first/last time ms,
+//                                         uint64 ids offset, uint32 id count }
+//   trailer  uint64 footer offset, "EWTRKEND"
+//
+// Strings (ids, types, priorities, categories) are stored as codes. Each
+// chunk carries the strings first used since the previous chunk, so every
+// code is defined at or before the first chunk that refers to it. An id
+// whose Removed row has been written may come back under a new code.
+//
+// Rows within a chunk are sorted by id code, then time. The per-chunk id
+// list gives each id's row range, so finding an id only reads the id lists
+// of chunks in the wanted time range. Everything in the footer is repeated
+// in the chunks, so a file cut short by a killed run can be indexed again
+// by walking the chunks from the header.
+class TrackFileWriter {
+public:
+    enum Table : quint8 { EntityTable = 0, EmitterTable = 1 };
+
+    // Entity state column; a Removed row is the last one written for that id
+    enum EntityState : quint8 { Active = 0, Removed = 1 };
+
+    explicit TrackFileWriter(int chunkRows = 65536);
+    ~TrackFileWriter();
+
+    bool open(const QString& path);
+    bool close();
+
+    void appendEntity(qint64 timeMs, const SimulatedEntity& entity, EntityState state = Active);
+    void appendEmitter(qint64 timeMs, const Emitter& emitter);
+
+    quint64 rowsWritten() const { return totalRows; }
+    quint64 entityRowsWritten() const { return entityRowCount; }
+    qint64 bytesWritten() const { return file.pos(); }
+
+private:
+    struct ChunkInfo {
+        quint64 offset;
+        quint64 bytes;
+        quint8 table;
+        quint32 rows;
+        qint64 firstTimeMs;
+        qint64 lastTimeMs;
+        quint64 idsOffset;
+        quint32 idCount;
+    };
+
+    // Per-field arrays of the chunk being filled
+    struct EntityColumns {
+        std::vector<qint64> timeMs;
+        std::vector<quint32> id;
+        std::vector<quint32> type;
+        std::vector<double> lat;
+        std::vector<double> lon;
+        std::vector<double> altitude;
+        std::vector<double> speed;
+        std::vector<double> heading;
+        std::vector<qint32> category;
+        std::vector<quint32> priority;
+        std::vector<quint8> jam;
+        std::vector<quint8> state;
+    };
+
+    struct EmitterColumns {
+        std::vector<qint64> timeMs;
+        std::vector<quint32> id;
+        std::vector<quint32> type;
+        std::vector<quint32> category;
+        std::vector<double> lat;
+        std::vector<double> lon;
+        std::vector<double> freqMin;
+        std::vector<double> freqMax;
+        std::vector<quint8> active;
+        std::vector<quint8> jam;
+    };
+
+    quint32 stringCode(const QString& value);
+    void flushEntities();
+    void flushEmitters();
+    void beginChunk(Table table, const std::vector<qint64>& timeMs, const std::vector<quint32>& ids);
+    void endChunk();
+
+    // Writes the column in rowOrder
+    template <typename T>
+    void writeColumn(const std::vector<T>& column) {
+        scratch.resize(rowOrder.size() * sizeof(T));
+        T* out = reinterpret_cast<T*>(scratch.data());
+        for (size_t row = 0; row < rowOrder.size(); ++row) {
+            out[row] = column[rowOrder[row]];
+        }
+        file.write(scratch.data(), scratch.size());
+    }
+
+    template <typename T>
+    void writeValue(T value) {
+        file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    QFile file;
+    int chunkRows;
+    quint64 totalRows;
+    quint64 entityRowCount;
+    EntityColumns entityRows;
+    EmitterColumns emitterRows;
+    QHash<QString, quint32> dictionary;     // Code of each string still in use
+    quint32 nextCode;
+    QVector<QString> newStrings;            // Codes from nextCode - size() on, not yet written
+    QVector<ChunkInfo> chunks;
+    std::vector<quint32> rowOrder;          // Chunk rows sorted by id, then time
+    std::vector<char> scratch;
+};
+
+#endif // TRACKFILE_H
@@ -0,0 +1,318 @@
+#include "trackStore.h"
+#include <cmath>
+#include <cstring>
+
+// Update lines are parsed by hand so ingest never allocates
+
+static const double EXACT_POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool parseNumber(const char*& p, const char* end, double& value) {
+    bool negative = p < end && *p == '-';
+    if (negative) ++p;
+
+    quint64 mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    const char* start = p;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa) ++digits;
+        } else {
+            ++exponent;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                if (mantissa) ++digits;
+                --exponent;
+            }
+        }
+    }
+    if (p == start) {
+        return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negativeExponent = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) ++p;
+        int written = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            if (written < 10000) written = written * 10 + (*p - '0');
+        }
+        exponent += negativeExponent ? -written : written;
+    }
+
+    value = static_cast<double>(mantissa);
+    if (exponent < 0 && exponent >= -22) {
+        value /= EXACT_POWERS_OF_TEN[-exponent];
+    } else if (exponent > 0 && exponent <= 22) {
+        value *= EXACT_POWERS_OF_TEN[exponent];
+    } else if (exponent != 0) {
+        value *= std::pow(10.0, exponent);
+    }
+    if (negative) value = -value;
+    return true;
+}
+
+// Leaves p on the closing quote
+static void skipString(const char*& p, const char* end) {
+    while (p < end && *p != '"') {
+        p += (*p == '\\') ? 2 : 1;
+    }
+}
+
+static bool keyIs(const char* key, int length, const char* name) {
+    return static_cast<int>(strlen(name)) == length && memcmp(key, name, length) == 0;
+}
+
+bool parseTrackLine(const char* line, int length, TrackLine& fields) {
+    const char* p = line;
+    const char* end = line + length;
+    while (p < end && *p != '{') ++p;
+    if (p == end) {
+        return false;
+    }
+    ++p;
+
+    bool hasLat = false;
+    bool hasLon = false;
+    while (p < end) {
+        // Key
+        while (p < end && *p != '"' && *p != '}') ++p;
+        if (p >= end || *p == '}') break;
+        const char* key = ++p;
+        skipString(p, end);
+        if (p >= end) break;
+        int keyLength = static_cast<int>(p - key);
+        ++p;
+        while (p < end && (*p == ':' || *p == ' ')) ++p;
+        if (p >= end) break;
+
+        // Value
+        if (*p == '"') {
+            const char* value = ++p;
+            skipString(p, end);
+            int valueLength = static_cast<int>(p - value);
+            if (keyIs(key, keyLength, "id")) {
+                fields.id = value;
+                fields.idLength = valueLength;
+            } else if (keyIs(key, keyLength, "state")) {
+                fields.removed = valueLength == 7 && memcmp(value, "removed", 7) == 0;
+            }
+            ++p;
+        } else if (*p == '-' || (*p >= '0' && *p <= '9')) {
+            double value;
+            if (!parseNumber(p, end, value)) break;
+            if (keyIs(key, keyLength, "lat")) { fields.lat = value; hasLat = true; }
+            else if (keyIs(key, keyLength, "lon")) { fields.lon = value; hasLon = true; }
+            else if (keyIs(key, keyLength, "altitude")) fields.altitude = value;
+            else if (keyIs(key, keyLength, "speed")) fields.speed = value;
+            else if (keyIs(key, keyLength, "heading")) fields.heading = value;
+        } else {
+            // true, false, null, or a nested value we do not ingest
+            int depth = 0;
+            for (; p < end; ++p) {
+                if (*p == '"') { ++p; skipString(p, end); continue; }
+                if (*p == '{' || *p == '[') ++depth;
+                else if (*p == '}' || *p == ']') { if (depth == 0) break; --depth; }
+                else if (*p == ',' && depth == 0) break;
+            }
+        }
+        if (keyIs(key, keyLength, "query")) {
+            fields.query = true;
+        }
+    }
+
+    fields.hasPosition = hasLat && hasLon;
+    return true;
+}
+
+TrackStore::TrackStore(int capacity, int historyLength)
+    : records(capacity)
+    , occupied(capacity, false)
+    , historyRing(static_cast<size_t>(capacity) * historyLength)
+    , historyLength(historyLength)
+    , count(0)
+    , rejectedUpdates(0)
+{
+    // Keep the index at most half full so probe sequences stay short
+    quint32 buckets = 2;
+    while (buckets < static_cast<quint32>(capacity) * 2) {
+        buckets <<= 1;
+    }
+    index.assign(buckets, -1);
+    indexMask = buckets - 1;
+
+    freeRecords.reserve(capacity);
+    for (int slot = capacity - 1; slot >= 0; --slot) {
+        freeRecords.push_back(slot);
+    }
+}
+
+quint32 TrackStore::hashId(const char* id, int idLength) {
+    // FNV-1a
+    quint32 hash = 2166136261u;
+    for (int i = 0; i < idLength; ++i) {
+        hash ^= static_cast<quint8>(id[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int TrackStore::findIndexSlot(const char* id, int idLength) const {
+    quint32 bucket = hashId(id, idLength) & indexMask;
+    while (index[bucket] >= 0) {
+        const TrackRecord& record = records[index[bucket]];
+        if (record.idLength == idLength && memcmp(record.id, id, idLength) == 0) {
+            return static_cast<int>(bucket);
+        }
+        bucket = (bucket + 1) & indexMask;
+    }
+    return -static_cast<int>(bucket) - 1;   // Free bucket where the id would go
+}
+
+bool TrackStore::ingest(const char* id, int idLength, const TrackSample& sample) {
+    if (idLength <= 0 || idLength > TrackRecord::MAX_ID_LENGTH) {
+        ++rejectedUpdates;
+        return false;
+    }
+
+    int bucket = findIndexSlot(id, idLength);
+    int slot;
+    if (bucket >= 0) {
+        slot = index[bucket];
+    } else {
+        if (freeRecords.empty()) {
+            ++rejectedUpdates;
+            return false;
+        }
+
+        slot = freeRecords.back();
+        freeRecords.pop_back();
+        index[-bucket - 1] = slot;
+        occupied[slot] = true;
+        ++count;
+
+        TrackRecord& record = records[slot];
+        memcpy(record.id, id, idLength);
+        record.id[idLength] = '\0';
+        record.idLength = idLength;
+        record.updates = 0;
+        record.historyStart = 0;
+        record.historyCount = 0;
+    }
+
+    TrackRecord& record = records[slot];
+    record.latest = sample;
+    ++record.updates;
+
+    // Append to the ring, overwriting the oldest sample once it is full
+    TrackSample* ring = &historyRing[static_cast<size_t>(slot) * historyLength];
+    if (record.historyCount < historyLength) {
+        ring[(record.historyStart + record.historyCount) % historyLength] = sample;
+        ++record.historyCount;
+    } else {
+        ring[record.historyStart] = sample;
+        record.historyStart = (record.historyStart + 1) % historyLength;
+    }
+    return true;
+}
+
+bool TrackStore::remove(const char* id, int idLength) {
+    if (idLength <= 0 || idLength > TrackRecord::MAX_ID_LENGTH) {
+        return false;
+    }
+
+    int bucket = findIndexSlot(id, idLength);
+    if (bucket < 0) {
+        return false;
+    }
+
+    int slot = index[bucket];
+    occupied[slot] = false;
+    freeRecords.push_back(slot);
+    --count;
+
+    // Backward-shift deletion: pull later entries of the probe run into the
+    // hole, so lookups never stop short of them and no tombstones build up
+    quint32 hole = bucket;
+    quint32 next = (hole + 1) & indexMask;
+    while (index[next] >= 0) {
+        const TrackRecord& record = records[index[next]];
+        quint32 home = hashId(record.id, record.idLength) & indexMask;
+        if (((next - home) & indexMask) >= ((next - hole) & indexMask)) {
+            index[hole] = index[next];
+            hole = next;
+        }
+        next = (next + 1) & indexMask;
+    }
+    index[hole] = -1;
+    return true;
+}
+
+const TrackRecord* TrackStore::find(const char* id, int idLength) const {
+    if (idLength <= 0 || idLength > TrackRecord::MAX_ID_LENGTH) {
+        return nullptr;
+    }
+
+    int bucket = findIndexSlot(id, idLength);
+    return bucket >= 0 ? &records[index[bucket]] : nullptr;
+}
+
+QVector<TrackSample> TrackStore::history(const TrackRecord& record) const {
+    size_t slot = &record - records.data();
+    const TrackSample* ring = &historyRing[slot * historyLength];
+
+    QVector<TrackSample> samples;
+    samples.reserve(record.historyCount);
+    for (int i = 0; i < record.historyCount; ++i) {
+        samples.append(ring[(record.historyStart + i) % historyLength]);
+    }
+    return samples;
+}
+
+double TrackStore::updateRate(const TrackRecord& record) const {
+    if (record.historyCount < 2) {
+        return 0.0;
+    }
+
+    size_t slot = &record - records.data();
+    const TrackSample* ring = &historyRing[slot * historyLength];
+    qint64 oldest = ring[record.historyStart].timeUs;
+    qint64 newest = record.latest.timeUs;
+    if (newest <= oldest) {
+        return 0.0;
+    }
+    return (record.historyCount - 1) * 1e6 / (newest - oldest);
+}
+
+QVector<const TrackRecord*> TrackStore::tracksInBox(double latMin, double latMax,
+                                                    double lonMin, double lonMax) const {
+    QVector<const TrackRecord*> matches;
+    for (size_t slot = 0; slot < records.size(); ++slot) {
+        if (!occupied[slot]) continue;
+
+        const TrackSample& latest = records[slot].latest;
+        if (latest.lat >= latMin && latest.lat <= latMax &&
+            latest.lon >= lonMin && latest.lon <= lonMax) {
+            matches.append(&records[slot]);
+        }
+    }
+    return matches;
+}
+
+QVector<const TrackRecord*> TrackStore::staleTracks(qint64 nowUs, qint64 maxAgeUs) const {
+    QVector<const TrackRecord*> matches;
+    for (size_t slot = 0; slot < records.size(); ++slot) {
+        if (occupied[slot] && nowUs - records[slot].latest.timeUs > maxAgeUs) {
+            matches.append(&records[slot]);
+        }
+    }
+    return matches;
+}
@@ -0,0 +1,91 @@
+#ifndef TRACKSTORE_H
+#define TRACKSTORE_H
+
+#include <QtGlobal>
+#include <QVector>
+#include <vector>
+
+struct TrackSample {
+    qint64 timeUs;      // Receive time on the store's clock
+    double lat;
+    double lon;
+    double altitude;
+    double speed;
+    double heading;
+};
+
+// Fields of one update line, as the server ingests them
+struct TrackLine {
+    const char* id = nullptr;   // Points into the line
+    int idLength = 0;
+    bool hasPosition = false;   // Both lat and lon were present
+    bool removed = false;       // "state":"removed"
+    bool query = false;         // Has a "query" key and needs a full JSON parse
+    double lat = 0.0;
+    double lon = 0.0;
+    double altitude = 0.0;
+    double speed = 0.0;
+    double heading = 0.0;
+};
+
+// Scans one flat JSON object in place for the fields the track store keeps.
+// Nothing is allocated and unknown keys are skipped; returns false when the
+// line is not a JSON object.
+bool parseTrackLine(const char* line, int length, TrackLine& fields);
+
+// Latest state of one id plus the location of its history ring
+struct TrackRecord {
+    static const int MAX_ID_LENGTH = 31;
+
+    char id[MAX_ID_LENGTH + 1];
+    int idLength;
+    TrackSample latest;
+    quint64 updates;
+    int historyStart;   // Oldest sample in the ring
+    int historyCount;
+};
+
+// Track store for server-mode ingest. All memory is allocated up front:
+// a record arena with a free list, a fixed-length history ring per record,
+// and an open-addressing index of record slots keyed on the id bytes.
+// Ingest never allocates; ids beyond capacity are counted and rejected.
+class TrackStore {
+public:
+    explicit TrackStore(int capacity = 65536, int historyLength = 32);
+
+    // Returns false when the id is too long or the store is full
+    bool ingest(const char* id, int idLength, const TrackSample& sample);
+
+    // Frees the id's record for reuse; returns false when it was not stored
+    bool remove(const char* id, int idLength);
+
+    const TrackRecord* find(const char* id, int idLength) const;
+    QVector<TrackSample> history(const TrackRecord& record) const;
+
+    // Updates per second over the record's history window
+    double updateRate(const TrackRecord& record) const;
+
+    QVector<const TrackRecord*> tracksInBox(double latMin, double latMax,
+                                            double lonMin, double lonMax) const;
+    QVector<const TrackRecord*> staleTracks(qint64 nowUs, qint64 maxAgeUs) const;
+
+    int size() const { return count; }
+    int capacity() const { return static_cast<int>(records.size()); }
+    quint64 rejected() const { return rejectedUpdates; }
+
+private:
+    static quint32 hashId(const char* id, int idLength);
+    int findIndexSlot(const char* id, int idLength) const;
+
+    std::vector<TrackRecord> records;
+    std::vector<bool> occupied;
+    std::vector<int> freeRecords;
+    std::vector<TrackSample> historyRing;   // historyLength samples per record
+    std::vector<int> index;                 // Record slot per bucket, -1 when empty
+    quint32 indexMask;
+    int historyLength;
+    int count;
+    quint64 rejectedUpdates;
+};
+
+#endif // TRACKSTORE_H
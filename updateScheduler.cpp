@@ -0,0 +1,69 @@
+#include "updateScheduler.h"
+
+UpdateScheduler::UpdateScheduler()
+    : nextSequence(0)
+    , messagesPerSecond(0)
+    , tokens(0)
+    , pendingCount(0)
+    , released(0)
+    , maxLatenessMs(0)
+{
+}
+
+void UpdateScheduler::setBudget(double rate) {
+    messagesPerSecond = rate;
+    tokens = rate;
+}
+
+void UpdateScheduler::schedule(EntityHandle handle, qint64 dueMs) {
+    queue.push(Entry{dueMs, nextSequence++, handle});
+    pendingCount.store(static_cast<int>(queue.size()), std::memory_order_relaxed);
+}
+
+void UpdateScheduler::clear() {
+    queue = std::priority_queue<Entry, std::vector<Entry>, DueLater>();
+    pendingCount.store(0, std::memory_order_relaxed);
+}
+
+void UpdateScheduler::refill(int deltaMs) {
+    if (messagesPerSecond <= 0) {
+        return;
+    }
+
+    tokens += messagesPerSecond * deltaMs / 1000.0;
+    if (tokens > messagesPerSecond) {
+        tokens = messagesPerSecond;
+    }
+}
+
+void UpdateScheduler::charge(int messages) {
+    if (messagesPerSecond > 0) {
+        tokens -= messages;
+    }
+}
+
+bool UpdateScheduler::popDue(qint64 nowMs, EntityHandle& handle, qint64& dueMs) {
+    if (queue.empty() || queue.top().dueMs > nowMs) {
+        return false;
+    }
+    if (messagesPerSecond > 0 && tokens < 1.0) {
+        return false;
+    }
+
+    handle = queue.top().handle;
+    dueMs = queue.top().dueMs;
+    queue.pop();
+    pendingCount.store(static_cast<int>(queue.size()), std::memory_order_relaxed);
+    return true;
+}
+
+void UpdateScheduler::markSent(qint64 latenessMs) {
+    if (latenessMs > maxLatenessMs.load(std::memory_order_relaxed)) {
+        maxLatenessMs.store(latenessMs, std::memory_order_relaxed);
+    }
+
+    if (messagesPerSecond > 0) {
+        tokens -= 1.0;
+    }
+    released.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,66 @@
+#ifndef UPDATESCHEDULER_H
+#define UPDATESCHEDULER_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <queue>
+#include <vector>
+#include "slotMap.h"
+
+// Decides which entities are sent on a tick. Every entity has one entry in
+// a min-heap keyed on its next-due simulation time; a token bucket refilled
+// at the global budget caps how many due entries are released per tick.
+// Entries left over when the budget runs out stay at the front of the heap,
+// so the most overdue entities go first on the next tick. Entries hold slot
+// handles, so despawned entities simply stop resolving when popped.
+class UpdateScheduler {
+public:
+    UpdateScheduler();
+
+    // Messages per second across all entities; 0 disables the cap
+    void setBudget(double messagesPerSecond);
+    double budget() const { return messagesPerSecond; }
+
+    void schedule(EntityHandle handle, qint64 dueMs);
+    void clear();
+
+    // Adds this tick's share of the budget, keeping at most one second banked
+    void refill(int deltaMs);
+
+    // Accounts for messages sent outside the scheduler
+    void charge(int messages);
+
+    // Pops the next entry due by nowMs, if the budget still allows a message.
+    // Nothing is spent until the caller confirms the send with markSent, so
+    // stale entries cost neither budget nor released count.
+    bool popDue(qint64 nowMs, EntityHandle& handle, qint64& dueMs);
+    void markSent(qint64 latenessMs);
+
+    // Readable from any thread
+    int pending() const { return pendingCount.load(std::memory_order_relaxed); }
+    quint64 takeReleased() { return released.exchange(0); }
+    qint64 takeMaxLatenessMs() { return maxLatenessMs.exchange(0); }
+
+private:
+    struct Entry {
+        qint64 dueMs;
+        quint64 sequence;   // Keeps equal due times in first-come order
+        EntityHandle handle;
+    };
+
+    struct DueLater {
+        bool operator()(const Entry& a, const Entry& b) const {
+            return a.dueMs != b.dueMs ? a.dueMs > b.dueMs : a.sequence > b.sequence;
+        }
+    };
+
+    std::priority_queue<Entry, std::vector<Entry>, DueLater> queue;
+    quint64 nextSequence;
+    double messagesPerSecond;
+    double tokens;
+    std::atomic<int> pendingCount;
+    std::atomic<quint64> released;
+    std::atomic<qint64> maxLatenessMs;
+};
+
+#endif // UPDATESCHEDULER_H